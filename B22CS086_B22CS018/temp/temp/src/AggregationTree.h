@@ -0,0 +1,37 @@
+#ifndef AGGREGATIONTREE_H
+#define AGGREGATIONTREE_H
+
+// Layout of the aggregation tree built over the subtasks a client dispatched.
+// Level 0 nodes each combine up to fanIn subtasks, level l nodes combine up to
+// fanIn nodes of level l-1, and the first level with at most fanIn nodes
+// reports straight to the client.
+namespace AggregationTree {
+
+    // Number of nodes on a given level for numSubtasks dispatched subtasks
+    inline int nodesAtLevel(int numSubtasks, int fanIn, int level) {
+        int count = numSubtasks;
+        for (int l = 0; l <= level; l++) {
+            count = (count + fanIn - 1) / fanIn;
+        }
+        return count;
+    }
+
+    // Number of children (subtasks for level 0) under a node
+    inline int childrenOf(int numSubtasks, int fanIn, int level, int index) {
+        int below = (level == 0) ? numSubtasks : nodesAtLevel(numSubtasks, fanIn, level - 1);
+        int remaining = below - index * fanIn;
+        return remaining < fanIn ? remaining : fanIn;
+    }
+
+    // Nodes on the top level send their aggregate to the client
+    inline bool isTopLevel(int numSubtasks, int fanIn, int level) {
+        return nodesAtLevel(numSubtasks, fanIn, level) <= fanIn;
+    }
+
+    // Aggregator module hosting a node; spreads a client's nodes over all aggregators
+    inline int moduleFor(int clientId, int level, int index, int numAggregators) {
+        return (clientId + level + index) % numAggregators;
+    }
+}
+
+#endif // AGGREGATIONTREE_H
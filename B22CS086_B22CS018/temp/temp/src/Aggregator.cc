@@ -0,0 +1,256 @@
+#include <omnetpp.h>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <climits>
+#include "AggregationTree.h"
+#include "VoteTracker.h"
+#include "MessagePool.h"
+#include "Profiler.h"
+#include "MemoryAccounting.h"
+#include "Logging.h"
+
+using namespace omnetpp;
+using namespace std;
+
+const string AGGREGATOR_OUTPUT = "output.txt";
+
+// Combines subtask results on behalf of clients. Leaf nodes vote on the replies
+// of their subtasks, inner nodes merge the aggregates of their children, and the
+// top level sends a single aggregate per node back to the client.
+class Aggregator : public cSimpleModule
+{
+private:
+    struct NodeState {
+        int childrenReceived;       // subtasks with all replies in (leaf) or child aggregates merged
+        int subtaskCount;           // subtasks covered by this node so far
+        int result;                 // max over the covered majority results
+        map<int, int> majorities;   // subtaskId -> majority result
+        map<int, int> serverScores; // serverId -> correct results
+        map<int, VoteTracker> votes; // subtaskId -> vote over its replicas, leaf only
+
+        NodeState() : childrenReceived(0), subtaskCount(0), result(INT_MIN) {}
+    };
+
+    // (clientId, taskId, level, index) -> node state
+    map<tuple<int, int, int, int>, NodeState> nodes;
+
+    int aggregatesSent;
+
+    // Received results and child aggregates are recycled into aggregates
+    MessagePool pool;
+
+    // Handler timings, only with REMOTEEXEC_PROFILE
+    PROFILER_MEMBER
+
+    // Memory account shared by all aggregators
+    MemoryAccounting::Account *nodeMemory;
+
+    // Estimated bytes of a node: the state, its map entry and the entries of its maps
+    static long nodeBytes(const NodeState &node) {
+        long entry = sizeof(int) * 2 + MemoryAccounting::TREE_NODE_OVERHEAD;
+        return sizeof(tuple<int, int, int, int>) + sizeof(NodeState) + MemoryAccounting::TREE_NODE_OVERHEAD +
+               (node.majorities.size() + node.serverScores.size()) * entry +
+               node.votes.size() * (sizeof(int) + sizeof(VoteTracker) + MemoryAccounting::TREE_NODE_OVERHEAD);
+    }
+
+public:
+    Aggregator() {
+        MemoryAccounting::getShared()->attach();
+    }
+
+    ~Aggregator() {
+        MemoryAccounting::getShared()->detach();
+    }
+
+protected:
+    void initialize() override {
+        aggregatesSent = 0;
+        nodeMemory = MemoryAccounting::getShared()->account("aggregator.nodes");
+        pool.setCapacity(par("messagePoolCapacity").intValue());
+    }
+
+    void handleMessage(cMessage *msg) override {
+        if (strcmp(msg->getName(), "ResultMessage") == 0) {
+            handleResult(msg);
+        } else if (strcmp(msg->getName(), "AggregateMessage") == 0) {
+            handleAggregate(msg);
+        }
+        pool.release(msg);
+    }
+
+    void finish() override {
+        recordScalar("aggregatesSent", aggregatesSent);
+        PROFILE_FINISH();
+        recordScalar("messagePoolHitRate", pool.getHitRate());
+        recordScalar("messagesAllocated", pool.getMessagesAllocated());
+        recordScalar("messageParsAllocated", pool.getParsAllocated());
+        recordScalar("messageParsReused", pool.getParsReused());
+    }
+
+    void handleResult(cMessage *msg) {
+        PROFILE_SCOPE("Aggregator::handleResult");
+        int clientId = msg->par("clientId").longValue();
+        int taskId = msg->par("taskId").longValue();
+        int subtaskId = msg->par("subtaskId").longValue();
+        int serverId = msg->par("serverId").longValue();
+        int result = msg->par("result").longValue();
+        int replicas = msg->par("replicas").longValue();
+        int fanIn = msg->par("fanIn").longValue();
+        int dispatched = msg->par("dispatched").longValue();
+        int group = msg->par("group").longValue();
+
+        auto key = make_tuple(clientId, taskId, 0, group);
+        long bytesBefore = nodes.count(key) ? nodeBytes(nodes[key]) : 0;
+        NodeState &node = nodes[key];
+        VoteTracker &vote = node.votes[subtaskId];
+        if (vote.getExpected() == 0) {
+            vote.reset(replicas);
+        }
+
+        if (vote.isDecided()) {
+            // Already decided: score the reply directly
+            if (result == vote.getMajority()) {
+                node.serverScores[serverId]++;
+            }
+        } else if (vote.add(serverId, result)) {
+            int majorityResult = vote.getMajority();
+            vote.forEachPendingReply([&](int replyServer, bool agreed) {
+                if (agreed) {
+                    node.serverScores[replyServer]++;
+                }
+            });
+            vote.clearPending();
+
+            node.majorities[subtaskId] = majorityResult;
+            node.result = max(node.result, majorityResult);
+            node.subtaskCount++;
+
+            LOG_DEBUG("Aggregator " + to_string(getIndex()) + " verified subtask " + to_string(subtaskId) +
+                      " of client " + to_string(clientId) + " task " + to_string(taskId) +
+                      ": majority " + to_string(majorityResult));
+        }
+
+        // The subtask is complete once every replica has been scored
+        if (vote.getReceived() < replicas) {
+            nodeMemory->replace(bytesBefore, nodeBytes(node));
+            return;
+        }
+        node.votes.erase(subtaskId);
+        node.childrenReceived++;
+
+        if (node.childrenReceived == AggregationTree::childrenOf(dispatched, fanIn, 0, group)) {
+            forward(clientId, taskId, 0, group, fanIn, dispatched, node);
+            nodes.erase(key);
+            nodeMemory->add(-bytesBefore);
+        } else {
+            nodeMemory->replace(bytesBefore, nodeBytes(node));
+        }
+    }
+
+    void handleAggregate(cMessage *msg) {
+        PROFILE_SCOPE("Aggregator::handleAggregate");
+        int clientId = msg->par("clientId").longValue();
+        int taskId = msg->par("taskId").longValue();
+        int fanIn = msg->par("fanIn").longValue();
+        int dispatched = msg->par("dispatched").longValue();
+        int childLevel = msg->par("level").longValue();
+        int childIndex = msg->par("index").longValue();
+
+        int level = childLevel + 1;
+        int index = childIndex / fanIn;
+
+        auto key = make_tuple(clientId, taskId, level, index);
+        long bytesBefore = nodes.count(key) ? nodeBytes(nodes[key]) : 0;
+        NodeState &node = nodes[key];
+
+        node.result = max(node.result, (int)msg->par("result").longValue());
+        node.subtaskCount += msg->par("subtaskCount").longValue();
+        parsePairs(msg->par("majorities").stringValue(), node.majorities, false);
+        parsePairs(msg->par("scores").stringValue(), node.serverScores, true);
+        node.childrenReceived++;
+
+        if (node.childrenReceived == AggregationTree::childrenOf(dispatched, fanIn, level, index)) {
+            forward(clientId, taskId, level, index, fanIn, dispatched, node);
+            nodes.erase(key);
+            nodeMemory->add(-bytesBefore);
+        } else {
+            nodeMemory->replace(bytesBefore, nodeBytes(node));
+        }
+    }
+
+    // Send a node's aggregate to its parent, or to the client from the top level
+    void forward(int clientId, int taskId, int level, int index, int fanIn, int dispatched, NodeState &node) {
+        cMessage *am = pool.acquire("AggregateMessage");
+
+        pool.addPar(am, "clientId") = clientId;
+        pool.addPar(am, "taskId") = taskId;
+        pool.addPar(am, "fanIn") = fanIn;
+        pool.addPar(am, "dispatched") = dispatched;
+        pool.addPar(am, "level") = level;
+        pool.addPar(am, "index") = index;
+        pool.addPar(am, "result") = node.result;
+        pool.addPar(am, "subtaskCount") = node.subtaskCount;
+        pool.addPar(am, "majorities") = formatPairs(node.majorities).c_str();
+        pool.addPar(am, "scores") = formatPairs(node.serverScores).c_str();
+
+        aggregatesSent++;
+
+        cModule *network = getParentModule();
+        if (AggregationTree::isTopLevel(dispatched, fanIn, level)) {
+            LOG_DEBUG("Aggregator " + to_string(getIndex()) + " sending aggregate of " +
+                      to_string(node.subtaskCount) + " subtasks to client " + to_string(clientId) +
+                      " for task " + to_string(taskId) + ": result " + to_string(node.result));
+            sendDirect(am, network->getSubmodule("client", clientId), "directIn");
+        } else {
+            int numAggregators = network->par("numAggregators");
+            int parent = AggregationTree::moduleFor(clientId, level + 1, index / fanIn, numAggregators);
+            sendDirect(am, network->getSubmodule("aggregator", parent), "directIn");
+        }
+    }
+
+    // Format: key1=value1,key2=value2,...
+    static string formatPairs(const map<int, int> &values) {
+        string str;
+        for (auto &p : values) {
+            if (!str.empty()) {
+                str += ",";
+            }
+            str += to_string(p.first) + "=" + to_string(p.second);
+        }
+        return str;
+    }
+
+    static void parsePairs(const string &str, map<int, int> &values, bool accumulate) {
+        istringstream ss(str);
+        string token;
+        while (getline(ss, token, ',')) {
+            size_t equalsPos = token.find('=');
+            if (equalsPos == string::npos) continue;
+
+            int key = stoi(token.substr(0, equalsPos));
+            int value = stoi(token.substr(equalsPos + 1));
+            if (accumulate) {
+                values[key] += value;
+            } else {
+                values[key] = value;
+            }
+        }
+    }
+
+    void logToFile(const string &line) {
+        PROFILE_SCOPE("Aggregator::log");
+        ofstream out(AGGREGATOR_OUTPUT, ios::app);
+        if (!out.is_open()) {
+            cout << "Error opening file " << AGGREGATOR_OUTPUT << "\n";
+            return;
+        }
+        out << line << "\n";
+        out.close();
+    }
+};
+
+Define_Module(Aggregator);
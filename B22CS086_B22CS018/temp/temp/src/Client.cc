@@ -2,20 +2,40 @@
 #include <vector>
 #include <sstream>
 #include <algorithm>
-#include <unordered_map>
 #include <random>
 #include <fstream>
 #include <iomanip>
 #include <ctime>
 #include <cstring>
 #include <map>
+#include "ResultCache.h"
+#include "AggregationTree.h"
+#include "DatasetSource.h"
+#include "VoteTracker.h"
+#include "ReputationTable.h"
+#include "MessagePool.h"
+#include "MetricsRegistry.h"
+#include "Profiler.h"
+#include "MemoryAccounting.h"
+#include "DecisionLog.h"
+#include "Logging.h"
+#include "CoroutineModule.h"
+#include "MapReduce.h"
+#include "TaskGraph.h"
 
 using namespace omnetpp;
 using namespace std;
 
 const string OUTPUT_FILE = "output.txt";
 
-class Client : public cSimpleModule {
+// Bytes of a TaskMessage besides its data string (ids and routing)
+const int TASK_HEADER_BYTES = 16;
+
+// Hedging deadlines use the most recent subtask latencies, once there are enough
+const int HEDGE_WINDOW = 256;
+const int HEDGE_MIN_SAMPLES = 10;
+
+class Client : public CoroutineModule {
 private:
     // Parameters
     int arraySize;
@@ -23,60 +43,363 @@ private:
     int numServers;
     int numClients;
 
-    // Task data
-    vector<int> dataArray;
-    vector<vector<int>> subtasks;
-
-    // For tracking results
-    unordered_map<int, vector<pair<int, int>>> subtaskResults; // subtaskId -> [(serverId, result)]
-    unordered_map<int, int> majorityResults; // subtaskId -> majority result
-    int finalResult;
-    int currentTaskId; // Track the current task ID
-    int tasksCompleted;
-
-    // Modified Server scores tracking
-    struct ServerTrackingInfo {
-        int score;          // Total correct results
-        int subtaskCount;   // Total subtasks given to this server
+    // Task data, owned by the dataset source and valid until the next task
+    DatasetSource *dataset;
+    const int *dataArray;
 
-        ServerTrackingInfo() : score(0), subtaskCount(0) {}
+    // A subtask is a view into dataArray, never a copy
+    struct SubtaskView {
+        int offset;
+        int length;
     };
+    vector<SubtaskView> subtasks;
+
+    // Servers chosen for each subtask of the current task
+    vector<vector<int>> subtaskServers;
+
+    // Adaptive chunking policy; per-server throughput lives in the reputation table
+    string chunkingPolicy;
+    vector<simtime_t> subtaskDispatchTime;
+    vector<simtime_t> linkFreeAt; // per server link: when the messages queued on it are transmitted
+    cHistogram chunkSpreadStats; // (longest - shortest chunk) / mean chunk, per task
+
+    // Elements per TaskMessage fragment (0 = whole subtask in one message)
+    int fragmentSize;
+
+    // Coalescing: all subtasks of a task for one server go out in one
+    // TaskMessage and come back in one ResultMessage
+    bool coalesceDispatch;
+    int taskMessagesSent;    // TaskMessages put on the links
+    int subtaskReplicasSent; // subtask copies they carried, one per subtask and server
+    int resultsReceived;     // subtask results the ResultMessages carried
+
+    // Dispatch-to-majority latency of each subtask and start-to-result latency of each task
+    simtime_t taskStartTime;
+    cHistogram subtaskLatencyStats;
+    cHistogram taskLatencyStats;
+    vector<double> subtaskLatencies; // every verified subtask, in decision order
+
+    // Hedging: a subtask without a majority by its deadline gets another server
+    bool hedging;
+    simtime_t hedgeDelay;  // deadline until HEDGE_MIN_SAMPLES latencies are known
+    double hedgeQuantile;  // latency quantile used as the deadline afterwards
+    int maxHedges;
+    vector<Trigger *> subtaskDecided; // held by the subtask's hedging watch, if any
+    vector<int> subtaskHedges;      // extra servers sent each subtask of the current task
+    cHistogram hedgedSubtaskLatencyStats;
+    int subtaskTimeouts;
+    int hedgedDispatches;
+
+    // MapReduce ("wordCount" jobs): the subtasks are the map stage, whose
+    // servers shuffle hash partitions of their counts to the reduce servers
+    // of each partition; the client votes on the reducers' replies
+    bool mapReduce;
+    int reducePartitions;
+    vector<vector<int>> partitionServers; // reduce replicas of each partition
+    string reducerList;                   // the same, as sent with the map subtasks ("1,3,4;0,2,4")
+    struct ReduceReply {
+        string counts;    // key=count,...
+        string mapScores; // map replicas the reducer judged, serverId=1 (agreed) or 0
+    };
+    vector<VoteTracker> partitionVotes;             // partition -> vote on the index of the counts
+    vector<vector<ReduceReply>> partitionReplies;   // partition -> distinct replies (the majority once decided)
+    map<int, long> jobCounts; // majority counts of the decided partitions
+    int decidedPartitions;
+    cHistogram partitionLatencyStats;
+
+    // Task graph: a subtask waits for the verified results of its predecessors,
+    // which it reduces along with its slice, and ready subtasks go out in
+    // order of their rank (longest remaining path, in elements)
+    TaskGraph taskGraph;       // empty = independent subtasks, all sent at once
+    vector<int> nodeResults;   // subtaskId -> majority result, once decided
+    vector<int> waitingInputs; // subtaskId -> predecessors not decided yet
+    vector<long> nodeRanks;
+    int criticalPathNodes;     // subtasks on the current task's critical path
+
+    // Subtasks dispatched and not yet decided, integrated over each task
+    int inFlightNodes;
+    int maxInFlightNodes;
+    double inFlightArea;
+    simtime_t lastInFlightChange;
+    cHistogram dagParallelismStats; // mean subtasks in flight per task
+
+    // Work stealing: servers may hand queued subtasks to idle peers, which
+    // then reply in their stead
+    bool workStealing;
+    int stolenResults;
+    simtime_t lastTaskCompleted; // makespan of this client's tasks
+
+    // Replies corrupted by a lossy link (see FaultInjector)
+    int packetsLost;
 
-    // Map to track scores and subtask counts for each server
-    unordered_map<int, ServerTrackingInfo> serverTracking;
-
-    // Map to track aggregated scores and subtask counts from all clients
-    unordered_map<int, ServerTrackingInfo> aggregatedServerTracking;
+    // For tracking results
+    vector<VoteTracker> votes; // subtaskId -> streaming majority vote
+    int decidedSubtasks;       // subtasks whose majority is folded into finalResult
+    int finalResult;           // running max over the decided subtasks
+    Trigger taskDone;          // fired when every subtask is decided
+    int currentTaskId; // Track the current task ID
 
-    // Map to maintain average scores for server selection
-    unordered_map<int, double> serverAvgScores;
+    // Majorities of the task before the current one, to score its late replies
+    int previousTaskId;
+    vector<int> previousResults;   // subtaskId -> majority result
+    vector<string> previousCounts; // partition -> majority counts (wordCount)
+    int tasksCompleted;
 
-    // For gossip protocol
-    unordered_map<string, bool> messageLog;
+    // Per-server scores and subtask counts for the current task, the totals
+    // aggregated from gossip with their average, and measured throughput
+    ReputationTable reputation;
+    bool warmStarted; // totals loaded from a snapshot, so task 1 already ranks servers
+
+    // For gossip protocol; merges are idempotent, so there is no dedup log
+    int gossipStale;      // gossip that brought nothing new and was not forwarded
+    long *gossipInFlight; // shared by all clients, sampled by the MetricsExporter
+    long *clientsFinished; // shared; idle servers stop looking for work to steal once all are done
+
+    // Verified-result cache (client-local or shared), nullptr when disabled
+    ResultCache localResultCache;
+    ResultCache *resultCache;
+    int subtasksFromCache;
+    int taskCacheHits;          // subtasks of the current task answered from the cache
+    cHistogram cacheHitStats;   // per task; cached subtasks are kept out of subtaskLatency
+
+    // Aggregation tree mode (fan-in 0 means results come straight back)
+    int aggregationFanIn;
+    int numAggregators;
+    int dispatchedSubtasks;
+    int resultMessagesReceived;
+    int aggregateMessagesReceived;
+
+    // Received results, aggregates and gossip are recycled into outgoing messages
+    MessagePool pool;
 
     // Random number generator
     mt19937 rng;
 
+    // Record/replay of everything the client receives (see DecisionLog.h)
+    string decisionLogMode;            // off, record or replay
+    DecisionLogWriter *decisionWriter; // record mode only
+    bool replaying;
+    int replayDivergences; // recorded replies from servers this replay did not select
+
+    // Handler timings, only with REMOTEEXEC_PROFILE
+    PROFILER_MEMBER
+
+    // Memory accounts of the client structures and this client's last measured share
+    MemoryAccounting::Account *taskDataMemory;
+    MemoryAccounting::Account *subtaskMemory;
+    MemoryAccounting::Account *reputationMemory;
+    MemoryAccounting::Account *resultCacheMemory;
+    MemoryAccounting::Account *taskPayloadMemory; // TaskMessages in flight
+    MemoryAccounting::Account *gossipMemory;      // GossipMessages in flight
+    long taskDataBytes;
+    long subtaskBytes;
+    long reputationBytes;
+    long resultCacheBytes;
+
+public:
+    Client() : dataset(nullptr), dataArray(nullptr), decisionWriter(nullptr) {
+        MemoryAccounting::getShared()->attach();
+        ResultCache::attachShared();
+    }
+
+    ~Client() {
+        MetricsRegistry::getShared()->removeGauges(this);
+        MemoryAccounting::getShared()->detach();
+        ResultCache::detachShared();
+        delete dataset;
+        delete decisionWriter;
+    }
+
 protected:
     virtual void initialize() override {
-        // Initialize random number generator
-        rng.seed(static_cast<unsigned int>(time(nullptr)) + getIndex());
-
         // Get parameters from NED file
         arraySize = par("arraySize");
         numSubtasks = par("numSubtasks");
         numServers = par("numServers");
         numClients = par("numClients");
 
+        // Record the external inputs of this client, or replay recorded ones
+        decisionLogMode = par("decisionLog").stdstringValue();
+        if (decisionLogMode != "off" && decisionLogMode != "record" && decisionLogMode != "replay") {
+            throw cRuntimeError("Unknown decisionLog '%s' (expected off, record or replay)", decisionLogMode.c_str());
+        }
+        replaying = (decisionLogMode == "replay");
+        replayDivergences = 0;
+        string decisionLogFile = par("decisionLogFile").stdstringValue() + "." + to_string(getIndex());
+
+        // Initialize random number generator; a replay reuses the recorded seed
+        unsigned int seed = static_cast<unsigned int>(time(nullptr)) + getIndex();
+
+        // Set up the source of task data
+        string datasetMode = par("datasetSource").stdstringValue();
+        if (replaying) {
+            dataset = loadDecisionLog(decisionLogFile, seed);
+        } else if (datasetMode == "random") {
+            dataset = new RandomDatasetSource([this]() { return (int)intuniform(1, 100); });
+        } else if (datasetMode == "stream") {
+            dataset = new StreamingDatasetSource((uint64_t)intuniform(0, INT_MAX), 1, 100);
+        } else if (datasetMode == "file") {
+            dataset = new MappedFileDatasetSource(par("datasetFile").stdstringValue(), (size_t)par("datasetOffset").intValue());
+        } else {
+            throw cRuntimeError("Unknown datasetSource '%s' (expected random, stream or file)", datasetMode.c_str());
+        }
+
+        rng.seed(seed);
+        if (decisionLogMode == "record") {
+            decisionWriter = new DecisionLogWriter(decisionLogFile, getIndex(), seed);
+        }
+
+        // Set up the verified-result cache
+        string cacheMode = par("resultCache").stdstringValue();
+        int cacheCapacity = par("resultCacheCapacity");
+        if (cacheMode == "local") {
+            localResultCache.setCapacity(cacheCapacity);
+            resultCache = &localResultCache;
+        } else if (cacheMode == "shared") {
+            resultCache = ResultCache::getShared();
+            resultCache->setCapacity(cacheCapacity);
+        } else if (cacheMode == "none") {
+            resultCache = nullptr;
+        } else {
+            throw cRuntimeError("Unknown resultCache mode '%s' (expected none, local or shared)", cacheMode.c_str());
+        }
+        subtasksFromCache = 0;
+        taskCacheHits = 0;
+        cacheHitStats.setName("cacheHitsPerTask");
+
+        chunkingPolicy = par("chunkingPolicy").stdstringValue();
+        if (chunkingPolicy != "fixed" && chunkingPolicy != "adaptive") {
+            throw cRuntimeError("Unknown chunkingPolicy '%s' (expected fixed or adaptive)", chunkingPolicy.c_str());
+        }
+        chunkSpreadStats.setName("chunkLengthSpread");
+        linkFreeAt.assign(gateSize("out"), SIMTIME_ZERO);
+
+        fragmentSize = par("fragmentSize");
+        coalesceDispatch = par("coalesceDispatch");
+        if (coalesceDispatch && fragmentSize > 0) {
+            throw cRuntimeError("coalesceDispatch sends whole subtasks and cannot be combined with fragmentSize");
+        }
+        taskMessagesSent = 0;
+        subtaskReplicasSent = 0;
+        resultsReceived = 0;
+        pool.setCapacity(par("messagePoolCapacity").intValue());
+        subtaskLatencyStats.setName("subtaskLatency");
+        taskLatencyStats.setName("taskLatency");
+
+        hedging = par("hedging");
+        hedgeDelay = par("hedgeDelay").doubleValue();
+        hedgeQuantile = par("hedgeQuantile").doubleValue();
+        maxHedges = par("maxHedges");
+        if (hedgeQuantile <= 0 || hedgeQuantile > 1) {
+            throw cRuntimeError("hedgeQuantile must be in (0, 1]");
+        }
+        hedgedSubtaskLatencyStats.setName("hedgedSubtaskLatency");
+        subtaskTimeouts = 0;
+        hedgedDispatches = 0;
+        packetsLost = 0;
+
+        aggregationFanIn = par("aggregationFanIn");
+        numAggregators = getParentModule()->par("numAggregators");
+        if (aggregationFanIn == 1 || aggregationFanIn < 0) {
+            throw cRuntimeError("aggregationFanIn must be 0 (disabled) or at least 2");
+        }
+        if (aggregationFanIn > 0 && numAggregators == 0) {
+            throw cRuntimeError("aggregationFanIn is set but the network has no aggregators");
+        }
+        if (aggregationFanIn > 0 && coalesceDispatch) {
+            throw cRuntimeError("coalesceDispatch replies to the client and cannot be combined with aggregationFanIn");
+        }
+        if (aggregationFanIn > 0 && hedging) {
+            throw cRuntimeError("hedging needs the votes at the client and cannot be combined with aggregationFanIn");
+        }
+        workStealing = getParentModule()->par("workStealing");
+        if (aggregationFanIn > 0 && workStealing) {
+            throw cRuntimeError("workStealing moves subtasks between servers at the client and cannot be combined with aggregationFanIn");
+        }
+        stolenResults = 0;
+        lastTaskCompleted = SIMTIME_ZERO;
+
+        string job = par("job").stdstringValue();
+        if (job != "max" && job != "wordCount") {
+            throw cRuntimeError("Unknown job '%s' (expected max or wordCount)", job.c_str());
+        }
+        mapReduce = (job == "wordCount");
+        reducePartitions = par("reducePartitions");
+        if (reducePartitions < 1) {
+            throw cRuntimeError("reducePartitions must be at least 1");
+        }
+        if (mapReduce && (aggregationFanIn > 0 || hedging || workStealing || coalesceDispatch || fragmentSize > 0 ||
+                          decisionLogMode != "off")) {
+            throw cRuntimeError("job = wordCount cannot be combined with aggregation, hedging, work stealing, "
+                                "coalescing, fragments or decision logs");
+        }
+        decidedPartitions = 0;
+        partitionLatencyStats.setName("partitionLatency");
+
+        string graph = par("taskGraph").stdstringValue();
+        if (!graph.empty()) {
+            if (aggregationFanIn > 0 || mapReduce) {
+                throw cRuntimeError("taskGraph cannot be combined with aggregation or wordCount jobs");
+            }
+            taskGraph.parse(graph, numSubtasks);
+        }
+        criticalPathNodes = 0;
+        inFlightNodes = 0;
+        maxInFlightNodes = 0;
+        inFlightArea = 0;
+        dagParallelismStats.setName("dagParallelism");
+        dispatchedSubtasks = 0;
+        resultMessagesReceived = 0;
+        aggregateMessagesReceived = 0;
+
         // Initialize server tracking structures
-        for (int i = 0; i < numServers; i++) {
-            serverTracking[i] = ServerTrackingInfo();
-            aggregatedServerTracking[i] = ServerTrackingInfo();
-            serverAvgScores[i] = 0.0;
+        string reputationMode = par("reputationTable").stdstringValue();
+        if (reputationMode != "dense" && reputationMode != "sparse") {
+            throw cRuntimeError("Unknown reputationTable '%s' (expected dense or sparse)", reputationMode.c_str());
+        }
+        reputation.configure(numServers, numClients, reputationMode == "sparse");
+        gossipStale = 0;
+        warmStarted = false;
+        string reputationLoad = par("reputationLoad").stdstringValue();
+        if (!reputationLoad.empty()) {
+            string path = reputationLoad + "." + to_string(getIndex());
+            ifstream in(path, ios::binary);
+            if (!in.is_open()) {
+                throw cRuntimeError("Cannot open reputation snapshot %s", path.c_str());
+            }
+            int rows = reputation.load(in);
+            warmStarted = true;
+            recordScalar("reputationRowsLoaded", rows);
         }
 
+        MemoryAccounting *memory = MemoryAccounting::getShared();
+        taskDataMemory = memory->account("client.taskData");
+        subtaskMemory = memory->account("client.subtasks");
+        reputationMemory = memory->account("client.reputation");
+        resultCacheMemory = memory->account(cacheMode == "shared" ? "sharedResultCache" : "client.resultCache");
+        taskPayloadMemory = memory->account("inFlight.taskPayload");
+        gossipMemory = memory->account("inFlight.gossip");
+        taskDataBytes = 0;
+        subtaskBytes = 0;
+        reputationBytes = 0;
+        resultCacheBytes = 0;
+        accountTables();
+
         tasksCompleted = 0;
         currentTaskId = 0; // Initialize task ID
+        previousTaskId = 0;
+        decidedSubtasks = 0;
+
+        // Live values for the MetricsExporter
+        MetricsRegistry *metrics = MetricsRegistry::getShared();
+        gossipInFlight = metrics->counter("gossipInFlight");
+        clientsFinished = metrics->counter("clientsFinished");
+        *clientsFinished = 0;
+        *gossipInFlight = 0;
+        metrics->addGauge(this, string(getFullName()) + ".outstandingSubtasks",
+                          [this]() { return (double)((int)votes.size() - decidedSubtasks); });
+        metrics->addGauge(this, string(getFullName()) + ".reputationSpread",
+                          [this]() { return reputation.avgScoreSpread(); });
 
         // Clear output file for this run
         if (getIndex() == 0) {
@@ -84,134 +407,270 @@ protected:
             outFile.close();
         }
 
-        // Schedule task execution
-        scheduleAt(simTime() + 1.0, new cMessage("StartTask"));
+        // Run the client's tasks
+        spawn(runClient());
     }
 
     virtual void handleMessage(cMessage *msg) override {
-        if (strcmp(msg->getName(), "StartTask") == 0) {
-            // Start a new task
-            startTask();
-            delete msg;
+        cPacket *pkt = dynamic_cast<cPacket *>(msg);
+        if (!replaying && strcmp(msg->getName(), "GossipMessage") == 0) {
+            // Out of flight whether it arrived intact or not
+            (*gossipInFlight)--;
+            gossipMemory->add(-(long)(strlen(msg->par("score").stringValue()) + 1));
+        }
+        if (pkt != nullptr && pkt->hasBitError()) {
+            // Lost on a lossy link
+            packetsLost++;
+            pool.release(msg);
+            return;
+        }
+
+        if (decisionWriter != nullptr && !msg->isSelfMessage()) {
+            recordArrival(msg);
+        }
+
+        if (strcmp(msg->getName(), "Resume") == 0) {
+            // A coroutine's sleep or deadline expired; the timer is kept for reuse
+            resume(msg);
         }
         else if (strcmp(msg->getName(), "ResultMessage") == 0) {
             // Handle result from server
             handleResultMessage(msg);
         }
+        else if (strcmp(msg->getName(), "AggregateMessage") == 0) {
+            // Handle combined results from the aggregation tree
+            handleAggregateMessage(msg);
+        }
         else if (strcmp(msg->getName(), "GossipMessage") == 0) {
             // Handle gossip message
             handleGossipMessage(msg);
         }
         else {
-            delete msg;
+            pool.release(msg);
+        }
+    }
+
+    virtual void finish() override {
+        subtaskLatencyStats.record();
+        if (resultCache != nullptr) {
+            cacheHitStats.record();
+        }
+        taskLatencyStats.record();
+        hedgedSubtaskLatencyStats.record();
+        if (mapReduce) {
+            partitionLatencyStats.record();
+        }
+        if (chunkingPolicy == "adaptive") {
+            chunkSpreadStats.record();
+        }
+        if (!taskGraph.isEmpty()) {
+            dagParallelismStats.record();
+            recordScalar("maxDagParallelism", maxInFlightNodes);
+            recordScalar("dagDepth", taskGraph.depth());
+            recordScalar("criticalPathSubtasks", criticalPathNodes);
+        }
+        recordScalar("subtaskLatencyP50", latencyQuantile(subtaskLatencies, subtaskLatencies.size(), 0.50));
+        recordScalar("subtaskLatencyP95", latencyQuantile(subtaskLatencies, subtaskLatencies.size(), 0.95));
+        recordScalar("subtaskLatencyP99", latencyQuantile(subtaskLatencies, subtaskLatencies.size(), 0.99));
+        recordScalar("subtaskTimeouts", subtaskTimeouts);
+        recordScalar("hedgedDispatches", hedgedDispatches);
+        recordScalar("packetsLost", packetsLost);
+        recordScalar("gossipStale", gossipStale);
+        recordScalar("makespan", lastTaskCompleted.dbl());
+        if (workStealing) {
+            recordScalar("stolenResults", stolenResults);
+        }
+        // Late replies to the last task have no next commit to ride on
+        reputation.commitTask(getIndex());
+        saveReputation();
+        if (decisionWriter != nullptr) {
+            decisionWriter->flush();
+            recordScalar("decisionLogBytes", (double)decisionWriter->getBytes());
+        }
+        if (replaying) {
+            recordScalar("replayDivergences", replayDivergences);
+        }
+        PROFILE_FINISH();
+        recordScalar("resultMessagesReceived", resultMessagesReceived);
+        recordScalar("aggregateMessagesReceived", aggregateMessagesReceived);
+        recordScalar("taskMessagesSent", taskMessagesSent);
+        recordScalar("subtaskReplicasSent", subtaskReplicasSent);
+        recordScalar("resultsReceived", resultsReceived);
+        if (tasksCompleted > 0) {
+            recordScalar("messagesPerTask", (double)(taskMessagesSent + resultMessagesReceived) / tasksCompleted);
+        }
+        if (coalesceDispatch && tasksCompleted > 0) {
+            int saved = (subtaskReplicasSent - taskMessagesSent) + (resultsReceived - resultMessagesReceived);
+            recordScalar("coalescedMessagesPerTask", (double)saved / tasksCompleted);
+        }
+        if (getIndex() == 0) {
+            recordEventsPerTask();
+        }
+        recordScalar("subtasksFromCache", subtasksFromCache);
+        recordScalar("messagePoolHitRate", pool.getHitRate());
+        recordScalar("messagesAllocated", pool.getMessagesAllocated());
+        recordScalar("messageParsAllocated", pool.getParsAllocated());
+        recordScalar("messageParsReused", pool.getParsReused());
+        // A shared cache is reported once, by client 0
+        if (resultCache != nullptr && (resultCache == &localResultCache || getIndex() == 0)) {
+            recordScalar("resultCacheHits", resultCache->getHits());
+            recordScalar("resultCacheMisses", resultCache->getMisses());
+            recordScalar("resultCacheEvictions", resultCache->getEvictions());
+        }
+    }
+
+    // Events of the whole run over the tasks all clients completed
+    void recordEventsPerTask() {
+        cModule *network = getParentModule();
+        int tasks = 0;
+        for (int i = 0; i < numClients; i++) {
+            tasks += check_and_cast<Client *>(network->getSubmodule("client", i))->tasksCompleted;
+        }
+        if (tasks > 0) {
+            recordScalar("eventsPerTask", (double)getSimulation()->getEventNumber() / tasks);
+        }
+    }
+
+    // Snapshot of the aggregated server tracking for a later warm start
+    void saveReputation() {
+        string reputationSave = par("reputationSave").stdstringValue();
+        if (reputationSave.empty()) {
+            return;
+        }
+        string path = reputationSave + "." + to_string(getIndex());
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out.is_open()) {
+            throw cRuntimeError("Cannot create reputation snapshot %s", path.c_str());
+        }
+        reputation.save(out);
+    }
+
+    // The client's whole run: task 1 at t=1s, then the next task 2s after each completes
+    CoTask runClient() {
+        co_await sleep(1.0);
+        for (;;) {
+            co_await runTask();
+
+            if (tasksCompleted >= 2) {  // We need to run two tasks as per the assignment
+                // Log simulation end
+                LOG_INFO("Client " + to_string(getIndex()) + " has completed all tasks");
+                (*clientsFinished)++;
+                co_return;
+            }
+
+            // Log completion of the current task
+            LOG_INFO("Client " + to_string(getIndex()) + " completed task " + to_string(currentTaskId) +
+                     " and will start the next task soon");
+            co_await sleep(2.0);
         }
     }
 
+    // One task: dispatch, wait until every subtask has a majority, combine
+    CoTask runTask() {
+        startTask();
+        co_await taskDone.wait();
+        completeTask();
+    }
+
     void startTask() {
+        PROFILE_SCOPE("Client::startTask");
+
         // Increment task ID for a new task
         currentTaskId = tasksCompleted + 1; // Tasks are 1-indexed
+        taskStartTime = simTime();
 
-        // Generate data array with random integers
-        generateDataArray();
+        // Fetch the data array from the dataset source
+        loadDataArray();
+
+        // Choose servers first so adaptive chunking can size subtasks for them
+        selectServers();
+        if (mapReduce) {
+            selectReducers();
+        }
 
         // Divide task into subtasks
         divideIntoSubtasks();
 
         // Log task start
-        logToFile("Client " + to_string(getIndex()) + " starting task " + to_string(currentTaskId) +
-                  " with array size " + to_string(arraySize));
+        LOG_INFO("Client " + to_string(getIndex()) + " starting task " + to_string(currentTaskId) +
+                 " with array size " + to_string(arraySize));
 
         // Reset tracking structures for new task
-        subtaskResults.clear();
-        majorityResults.clear();
-
-        // For a new task, reset the server tracking info for the current task
-        for (int i = 0; i < numServers; i++) {
-            serverTracking[i].score = 0;
-            serverTracking[i].subtaskCount = 0;
-        }
+        decidedSubtasks = 0;
+        taskCacheHits = 0;
+        finalResult = INT_MIN;
+        taskDone.reset();
 
         // Dispatch subtasks to servers
-        dispatchSubtasks();
-    }
-
-    void generateDataArray() {
-        dataArray.clear();
-        for (int i = 0; i < arraySize; i++) {
-            dataArray.push_back(intuniform(1, 100));
-        }
-
-        stringstream ss;
-        ss << "Client " << getIndex() << " generated array: ";
-        for (int i = 0; i < min(10, (int)dataArray.size()); i++) {
-            ss << dataArray[i] << " ";
+        if (mapReduce) {
+            dispatchJob();
+        } else {
+            dispatchSubtasks();
         }
-        if (dataArray.size() > 10) {
-            ss << "... (total " << dataArray.size() << " elements)";
-        }
-        logToFile(ss.str());
     }
 
-    void divideIntoSubtasks() {
-        subtasks.clear();
-        int elementsPerSubtask = arraySize / numSubtasks;
-
-        // Ensure each subtask has at least 2 elements as per requirement
-        if (elementsPerSubtask < 2) {
-            elementsPerSubtask = 2;
-            numSubtasks = arraySize / elementsPerSubtask;
-            if (numSubtasks == 0) numSubtasks = 1;
+    void loadDataArray() {
+        dataArray = dataset->nextTask(currentTaskId, arraySize);
+        if (decisionWriter != nullptr) {
+            decisionWriter->task(currentTaskId, dataArray, arraySize);
         }
 
-        for (int i = 0; i < numSubtasks; i++) {
-            vector<int> subtask;
-            int start = i * elementsPerSubtask;
-            int end = (i == numSubtasks - 1) ? arraySize : (i + 1) * elementsPerSubtask;
-
-            for (int j = start; j < end; j++) {
-                subtask.push_back(dataArray[j]);
-            }
+        long bytes = (long)arraySize * sizeof(int);
+        taskDataMemory->replace(taskDataBytes, bytes);
+        taskDataBytes = bytes;
 
-            subtasks.push_back(subtask);
-        }
-
-        // Log subtask division
-        for (int i = 0; i < (int)subtasks.size(); i++) {
+        if (LOG_ENABLED(DEBUG)) {
             stringstream ss;
-            ss << "Client " << getIndex() << " subtask " << i << ": ";
-            for (int j = 0; j < min(5, (int)subtasks[i].size()); j++) {
-                ss << subtasks[i][j] << " ";
+            ss << "Client " << getIndex() << " generated array: ";
+            for (int i = 0; i < min(10, arraySize); i++) {
+                ss << dataArray[i] << " ";
             }
-            if (subtasks[i].size() > 5) {
-                ss << "... (total " << subtasks[i].size() << " elements)";
+            if (arraySize > 10) {
+                ss << "... (total " << arraySize << " elements)";
             }
             logToFile(ss.str());
         }
     }
 
-    void dispatchSubtasks() {
+    void selectServers() {
+        // Ensure each subtask has at least 2 elements as per requirement
+        if (arraySize / numSubtasks < 2) {
+            numSubtasks = arraySize / 2;
+            if (numSubtasks == 0) numSubtasks = 1;
+        }
+
         // Choose servers for each subtask
         int serversPerSubtask = (int)ceil(numServers / 2) + 1;
 
-        for (int subtaskId = 0; subtaskId < (int)subtasks.size(); subtaskId++) {
-            vector<int> selectedServers;
+        // After the first task (or from a warm start) every subtask goes to the
+        // servers with the best average scores
+        bool ranked = tasksCompleted > 0 || warmStarted;
+        vector<int> topServers;
+        vector<int> tiedServers; // adaptive chunking: equally ranked candidates for the last places
+        int tiedPlaces = 0;
+        if (ranked) {
+            topServers = reputation.topServers(serversPerSubtask);
+            if (chunkingPolicy == "adaptive" && !topServers.empty()) {
+                splitTiedServers(topServers, tiedServers, tiedPlaces);
+            }
+        }
 
-            // If this is the second task, select servers based on scores
-            if (tasksCompleted > 0) {
-                // Sort servers by their average scores
-                vector<pair<double, int>> serverRankings;
-                for (int i = 0; i < numServers; i++) {
-                    serverRankings.push_back({serverAvgScores[i], i});
-                }
-                sort(serverRankings.rbegin(), serverRankings.rend()); // Sort in descending order
+        subtaskServers.assign(numSubtasks, vector<int>());
+        for (int subtaskId = 0; subtaskId < numSubtasks; subtaskId++) {
+            vector<int> &selectedServers = subtaskServers[subtaskId];
 
-                // Select top servers
-                for (int i = 0; i < serversPerSubtask && i < serverRankings.size(); i++) {
-                    selectedServers.push_back(serverRankings[i].second);
+            // If this is the second task, select servers based on scores
+            if (ranked) {
+                // Select top servers; the places shared by equally ranked
+                // servers rotate over them, so the subtasks differ in their
+                // slowest replica without giving up any reputation
+                selectedServers = topServers;
+                for (int place = 0; place < tiedPlaces; place++) {
+                    selectedServers.push_back(tiedServers[(subtaskId + place) % tiedServers.size()]);
                 }
 
                 // Log server selection strategy
-                logToFile("Client " + to_string(getIndex()) + " selecting servers based on scores for task " + to_string(currentTaskId));
+                LOG_DEBUG("Client " + to_string(getIndex()) + " selecting servers based on scores for task " + to_string(currentTaskId));
             } else {
                 // For first task, randomly select servers
                 vector<int> allServers;
@@ -228,189 +687,1037 @@ protected:
                 }
 
                 // Log server selection strategy
-                logToFile("Client " + to_string(getIndex()) + " randomly selecting servers for task " + to_string(currentTaskId));
+                LOG_DEBUG("Client " + to_string(getIndex()) + " randomly selecting servers for task " + to_string(currentTaskId));
+            }
+        }
+    }
+
+    // Split the top servers into those ranked above the last one's average
+    // score, which every subtask gets, and all servers tied with it (sorted
+    // slowest first), which fill the remaining places
+    void splitTiedServers(vector<int> &topServers, vector<int> &tiedServers, int &tiedPlaces) {
+        auto avgScoreOf = [this](int serverId) {
+            int row = reputation.findRow(serverId);
+            return row < 0 ? 0.0 : reputation.getAvgScore(row);
+        };
+        double cutoff = avgScoreOf(topServers.back());
+        for (int serverId : reputation.topServers(numServers)) {
+            if (avgScoreOf(serverId) == cutoff) {
+                tiedServers.push_back(serverId);
+            }
+        }
+        vector<int> above;
+        for (int serverId : topServers) {
+            if (avgScoreOf(serverId) > cutoff) {
+                above.push_back(serverId);
+            }
+        }
+        tiedPlaces = topServers.size() - above.size();
+        topServers.swap(above);
+        sortBySlowest(tiedServers);
+    }
+
+    // Slowest measured throughput first; unmeasured servers count as the mean
+    void sortBySlowest(vector<int> &servers) {
+        double defaultThroughput = reputation.meanThroughput();
+        auto throughputOf = [&](int serverId) {
+            double throughput = reputation.getThroughput(serverId);
+            return throughput > 0 ? throughput : defaultThroughput;
+        };
+        stable_sort(servers.begin(), servers.end(), [&](int a, int b) {
+            return throughputOf(a) < throughputOf(b);
+        });
+    }
+
+    // Reduce replicas of every partition, chosen like the map replicas
+    void selectReducers() {
+        int serversPerPartition = (int)ceil(numServers / 2) + 1;
+        bool ranked = tasksCompleted > 0 || warmStarted;
+
+        partitionServers.assign(reducePartitions, vector<int>());
+        reducerList.clear();
+        for (int partition = 0; partition < reducePartitions; partition++) {
+            vector<int> &selectedServers = partitionServers[partition];
+            if (ranked) {
+                selectedServers = reputation.topServers(serversPerPartition);
+            } else {
+                vector<int> allServers;
+                for (int i = 0; i < numServers; i++) {
+                    allServers.push_back(i);
+                }
+                shuffle(allServers.begin(), allServers.end(), rng);
+                for (int i = 0; i < serversPerPartition && i < (int)allServers.size(); i++) {
+                    selectedServers.push_back(allServers[i]);
+                }
+            }
+
+            string servers;
+            for (int serverId : selectedServers) {
+                servers += (servers.empty() ? "" : ",") + to_string(serverId);
+            }
+            reducerList += (partition > 0 ? ";" : "") + servers;
+        }
+
+        LOG_DEBUG("Client " + to_string(getIndex()) + " reduce servers per partition for task " +
+                  to_string(currentTaskId) + ": " + reducerList);
+    }
+
+    void divideIntoSubtasks() {
+        // Subtasks are (offset, length) views into dataArray
+        vector<int> lengths = (chunkingPolicy == "adaptive") ? adaptiveChunkLengths() : fixedChunkLengths();
+
+        subtasks.clear();
+        int offset = 0;
+        for (int length : lengths) {
+            subtasks.push_back({offset, length});
+            offset += length;
+        }
+        auto extremes = minmax_element(lengths.begin(), lengths.end());
+        chunkSpreadStats.collect((double)(*extremes.second - *extremes.first) * lengths.size() / arraySize);
+
+        // Log subtask division
+        for (int i = 0; i < (int)subtasks.size() && LOG_ENABLED(DEBUG); i++) {
+            const int *data = subtaskData(i);
+            stringstream ss;
+            ss << "Client " << getIndex() << " subtask " << i << ": ";
+            for (int j = 0; j < min(5, subtasks[i].length); j++) {
+                ss << data[j] << " ";
+            }
+            if (subtasks[i].length > 5) {
+                ss << "... (total " << subtasks[i].length << " elements)";
+            }
+            logToFile(ss.str());
+        }
+    }
+
+    // Equal chunks, the last one takes the remainder
+    vector<int> fixedChunkLengths() {
+        int elementsPerSubtask = arraySize / numSubtasks;
+        vector<int> lengths(numSubtasks, elementsPerSubtask);
+        lengths.back() = arraySize - elementsPerSubtask * (numSubtasks - 1);
+        return lengths;
+    }
+
+    // Chunks proportional to the throughput of the slowest server holding each
+    // subtask, so that all replicas of all subtasks finish at about the same time
+    vector<int> adaptiveChunkLengths() {
+        // Servers without measurements are assumed to run at the mean measured rate
+        double defaultThroughput = reputation.meanThroughput();
+        if (defaultThroughput <= 0) {
+            return fixedChunkLengths();
+        }
+
+        vector<double> weights(numSubtasks);
+        double totalWeight = 0;
+        for (int i = 0; i < numSubtasks; i++) {
+            double slowest = -1;
+            for (int serverId : subtaskServers[i]) {
+                double throughput = reputation.getThroughput(serverId);
+                if (throughput <= 0) {
+                    throughput = defaultThroughput;
+                }
+                if (slowest < 0 || throughput < slowest) {
+                    slowest = throughput;
+                }
+            }
+            weights[i] = slowest > 0 ? slowest : defaultThroughput;
+            totalWeight += weights[i];
+        }
+
+        // Every subtask keeps at least 2 elements; the rest is shared by weight
+        int spare = max(0, arraySize - 2 * numSubtasks);
+        vector<int> lengths(numSubtasks);
+        int assigned = 0;
+        for (int i = 0; i < numSubtasks; i++) {
+            lengths[i] = 2 + (int)(spare * weights[i] / totalWeight);
+            assigned += lengths[i];
+        }
+        lengths.back() += arraySize - assigned;
+
+        if (LOG_ENABLED(DEBUG)) {
+            stringstream ss;
+            ss << "Client " << getIndex() << " adaptive chunk sizes for task " << currentTaskId << ": ";
+            for (int length : lengths) {
+                ss << length << " ";
+            }
+            logToFile(ss.str());
+        }
+
+        return lengths;
+    }
+
+    const int *subtaskData(int subtaskId) const {
+        return dataArray + subtasks[subtaskId].offset;
+    }
+
+    // Fold a reply's round trip into the server's smoothed throughput
+    void updateThroughput(int serverId, int subtaskId) {
+        simtime_t roundTrip = simTime() - subtaskDispatchTime[subtaskId];
+        if (roundTrip <= SIMTIME_ZERO) {
+            return; // Instant replies carry no rate information
+        }
+
+        double sample = subtasks[subtaskId].length / roundTrip.dbl();
+        double throughput = reputation.getThroughput(serverId);
+        reputation.setThroughput(serverId, (throughput > 0) ? 0.7 * throughput + 0.3 * sample : sample);
+    }
+
+    void dispatchSubtasks() {
+        subtaskDispatchTime.assign(subtasks.size(), simTime());
+        subtaskHedges.assign(subtasks.size(), 0);
+        // Watches left from the previous task end before their slots go
+        for (Trigger *decided : subtaskDecided) {
+            if (decided != nullptr) {
+                decided->fire();
+            }
+        }
+        subtaskDecided.assign(subtasks.size(), nullptr);
+        votes.assign(subtasks.size(), VoteTracker());
+        for (int subtaskId = 0; subtaskId < (int)subtasks.size(); subtaskId++) {
+            votes[subtaskId].reset(subtaskServers[subtaskId].size());
+        }
+
+        // Only subtasks without undecided predecessors can go out now
+        if (!taskGraph.isEmpty() && taskGraph.size() != (int)subtasks.size()) {
+            throw cRuntimeError("taskGraph is defined for %d subtasks, task %d has %d", taskGraph.size(),
+                                currentTaskId, (int)subtasks.size());
+        }
+        nodeResults.assign(subtasks.size(), 0);
+        waitingInputs.assign(subtasks.size(), 0);
+        vector<int> ready;
+        for (int subtaskId = 0; subtaskId < (int)subtasks.size(); subtaskId++) {
+            if (!taskGraph.isEmpty()) {
+                waitingInputs[subtaskId] = taskGraph.predecessorsOf(subtaskId).size();
+            }
+            if (waitingInputs[subtaskId] == 0) {
+                ready.push_back(subtaskId);
             }
+        }
+        if (!taskGraph.isEmpty()) {
+            vector<long> cost(subtasks.size());
+            for (int subtaskId = 0; subtaskId < (int)subtasks.size(); subtaskId++) {
+                cost[subtaskId] = subtasks[subtaskId].length;
+            }
+            nodeRanks = taskGraph.ranks(cost);
+            criticalPathNodes = taskGraph.criticalPathNodes(cost);
+        }
+        inFlightNodes = 0;
+        inFlightArea = 0;
+        lastInFlightChange = simTime();
+        dispatchedSubtasks = 0;
+
+        dispatchReady(ready);
+
+        accountSubtaskState();
+        accountTables();
+
+        // Every subtask may have been served from the cache
+        if (decidedSubtasks == (int)subtasks.size()) {
+            taskDone.fire();
+        }
+    }
+
+    // Send subtasks whose inputs are all decided, the most critical first.
+    // Those served from the cache are decided at once and may make their
+    // successors ready as well.
+    void dispatchReady(vector<int> ready) {
+        // Skip dispatch of payloads that were already verified by majority
+        vector<int> pendingSubtasks;
+        while (!ready.empty()) {
+            vector<int> nowReady;
+            for (int subtaskId : ready) {
+                int cachedResult;
+                if (isCacheable(subtaskId) &&
+                    resultCache->lookup(subtaskData(subtaskId), subtasks[subtaskId].length, KERNEL_MAX, cachedResult)) {
+                    votes[subtaskId].settle(cachedResult);
+                    foldMajority(subtaskId, cachedResult);
+                    subtasksFromCache++;
+                    taskCacheHits++;
+                    LOG_DEBUG("Client " + to_string(getIndex()) + " reused cached result " + to_string(cachedResult) +
+                              " for subtask " + to_string(subtaskId) + " in task " + to_string(currentTaskId));
+                    releaseSuccessors(subtaskId, nowReady);
+                } else {
+                    pendingSubtasks.push_back(subtaskId);
+                }
+            }
+            ready.swap(nowReady);
+        }
+        if (!taskGraph.isEmpty()) {
+            stable_sort(pendingSubtasks.begin(), pendingSubtasks.end(),
+                        [this](int a, int b) { return nodeRanks[a] > nodeRanks[b]; });
+        }
+        dispatchedSubtasks += pendingSubtasks.size();
+
+        // serverId -> subtasks to send it in one TaskMessage, when coalescing
+        map<int, vector<int>> bundles;
+
+        for (int position = 0; position < (int)pendingSubtasks.size(); position++) {
+            int subtaskId = pendingSubtasks[position];
+            const vector<int> &selectedServers = subtaskServers[subtaskId];
+            subtaskDispatchTime[subtaskId] = simTime();
+            trackInFlight(1);
 
             // Send subtask to selected servers
             for (int serverId : selectedServers) {
                 // Increment subtask count for this server
-                serverTracking[serverId].subtaskCount++;
+                reputation.addTaskSubtask(serverId);
 
-                sendSubtask(subtaskId, subtasks[subtaskId], serverId);
+                if (coalesceDispatch) {
+                    bundles[serverId].push_back(subtaskId);
+                } else {
+                    sendSubtask(subtaskId, serverId, position, selectedServers.size());
+                }
             }
 
             // Log server selection
+            if (LOG_ENABLED(DEBUG)) {
+                stringstream ss;
+                ss << "Client " << getIndex() << " sent subtask " << subtaskId << " to servers: ";
+                for (int serverId : selectedServers) {
+                    ss << serverId << " ";
+                }
+                if (!taskGraph.isEmpty()) {
+                    ss << "(rank " << nodeRanks[subtaskId] << ")";
+                }
+                logToFile(ss.str());
+            }
+
+            if (hedging) {
+                spawn(watchSubtask(subtaskId));
+            }
+        }
+
+        for (auto &bundle : bundles) {
+            if (bundle.second.size() == 1) {
+                sendSubtask(bundle.second[0], bundle.first, 0, subtaskServers[bundle.second[0]].size());
+            } else {
+                sendBundle(bundle.first, bundle.second);
+            }
+        }
+    }
+
+    // Successors of a decided subtask that now have all their inputs
+    void releaseSuccessors(int subtaskId, vector<int> &ready) {
+        if (taskGraph.isEmpty()) {
+            return;
+        }
+        for (int next : taskGraph.successorsOf(subtaskId)) {
+            if (--waitingInputs[next] == 0) {
+                ready.push_back(next);
+            }
+        }
+    }
+
+    // Time-weighted count of the subtasks in flight
+    void trackInFlight(int change) {
+        inFlightArea += inFlightNodes * (simTime() - lastInFlightChange).dbl();
+        lastInFlightChange = simTime();
+        inFlightNodes += change;
+        maxInFlightNodes = max(maxInFlightNodes, inFlightNodes);
+    }
+
+    // A subtask's result depends only on its slice unless it has predecessors
+    bool isCacheable(int subtaskId) const {
+        return resultCache != nullptr && (taskGraph.isEmpty() || taskGraph.predecessorsOf(subtaskId).empty());
+    }
+
+    // The elements a subtask reduces: its slice, then the verified results of
+    // its predecessors, copied into buffer
+    const int *subtaskInput(int subtaskId, int &length, vector<int> &buffer) const {
+        length = subtasks[subtaskId].length;
+        if (taskGraph.isEmpty() || taskGraph.predecessorsOf(subtaskId).empty()) {
+            return subtaskData(subtaskId);
+        }
+        buffer.assign(subtaskData(subtaskId), subtaskData(subtaskId) + length);
+        for (int predecessor : taskGraph.predecessorsOf(subtaskId)) {
+            buffer.push_back(nodeResults[predecessor]);
+        }
+        length = buffer.size();
+        return buffer.data();
+    }
+
+    // MapReduce: every subtask is a map subtask; nothing comes back until the
+    // reducers report, which also judge the map replicas
+    void dispatchJob() {
+        subtaskDispatchTime.assign(subtasks.size(), simTime());
+        subtaskHedges.assign(subtasks.size(), 0);
+        votes.clear();
+        dispatchedSubtasks = subtasks.size();
+
+        partitionVotes.assign(reducePartitions, VoteTracker());
+        partitionReplies.assign(reducePartitions, vector<ReduceReply>());
+        for (int partition = 0; partition < reducePartitions; partition++) {
+            partitionVotes[partition].reset(partitionServers[partition].size());
+            for (int serverId : partitionServers[partition]) {
+                reputation.addTaskSubtask(serverId);
+            }
+        }
+        jobCounts.clear();
+        decidedPartitions = 0;
+
+        for (int subtaskId = 0; subtaskId < (int)subtasks.size(); subtaskId++) {
+            for (int serverId : subtaskServers[subtaskId]) {
+                sendSubtask(subtaskId, serverId, subtaskId, subtaskServers[subtaskId].size());
+            }
+        }
+
+        accountSubtaskState();
+        accountTables();
+    }
+
+    void sendSubtask(int subtaskId, int serverId, int position, int replicas) {
+        vector<int> input;
+        int length;
+        const int *data = subtaskInput(subtaskId, length, input);
+
+        // Large subtasks go out as a stream of fragments the server reduces as they arrive
+        int fragmentLength = (fragmentSize > 0) ? fragmentSize : length;
+        int fragments = (length + fragmentLength - 1) / fragmentLength;
+
+        for (int fragment = 0; fragment < fragments; fragment++) {
+            int start = fragment * fragmentLength;
+            int end = min(length, start + fragmentLength);
+
+            // Convert data to string
+            string payload;
+            {
+                PROFILE_SCOPE("Client::serialize");
+                stringstream ss;
+                for (int i = start; i < end; i++) {
+                    ss << data[i] << " ";
+                }
+                payload = ss.str();
+            }
+
+            // Create task message
+            cPacket *msg = pool.acquire("TaskMessage");
+            msg->setByteLength(TASK_HEADER_BYTES + payload.size());
+
+            // Add taskId parameter
+            pool.addPar(msg, "taskId") = currentTaskId;
+            pool.addPar(msg, "subtaskId") = subtaskId;
+            pool.addPar(msg, "data") = payload.c_str();
+
+            if (fragments > 1) {
+                pool.addPar(msg, "fragment") = fragment;
+                pool.addPar(msg, "fragments") = fragments;
+            }
+
+            // Servers never hand a subtask to a peer that already holds a replica of it
+            if (workStealing) {
+                string holders;
+                for (int holder : subtaskServers[subtaskId]) {
+                    holders += (holders.empty() ? "" : ",") + to_string(holder);
+                }
+                pool.addPar(msg, "holders") = holders.c_str();
+            }
+
+            // A map subtask: where its servers shuffle each partition to
+            if (mapReduce) {
+                pool.addPar(msg, "stage") = "map";
+                pool.addPar(msg, "mapSubtasks") = (int)subtasks.size();
+                pool.addPar(msg, "replicas") = replicas;
+                pool.addPar(msg, "reducers") = reducerList.c_str();
+            }
+
+            // In aggregation mode the server reports to the leaf aggregator of this subtask
+            if (aggregationFanIn > 0) {
+                int group = position / aggregationFanIn;
+
+                pool.addPar(msg, "aggregator") = AggregationTree::moduleFor(getIndex(), 0, group, numAggregators);
+                pool.addPar(msg, "group") = group;
+                pool.addPar(msg, "clientId") = getIndex();
+                pool.addPar(msg, "fanIn") = aggregationFanIn;
+                pool.addPar(msg, "dispatched") = dispatchedSubtasks;
+                pool.addPar(msg, "replicas") = replicas;
+            }
+
+            // Send to appropriate server
+            sendToServer(msg, serverId);
+        }
+        subtaskReplicasSent++;
+    }
+
+    // Several subtasks for one server in a single TaskMessage: "subtaskIds"
+    // lists them and "data" holds their payloads separated by ';'
+    void sendBundle(int serverId, const vector<int> &subtaskIds) {
+        string ids;
+        string payload;
+        {
+            PROFILE_SCOPE("Client::serialize");
             stringstream ss;
-            ss << "Client " << getIndex() << " sent subtask " << subtaskId << " to servers: ";
-            for (int serverId : selectedServers) {
-                ss << serverId << " ";
+            for (int subtaskId : subtaskIds) {
+                if (!ids.empty()) {
+                    ids += ",";
+                    ss << ";";
+                }
+                ids += to_string(subtaskId);
+
+                vector<int> input;
+                int length;
+                const int *data = subtaskInput(subtaskId, length, input);
+                for (int i = 0; i < length; i++) {
+                    ss << data[i] << " ";
+                }
             }
-            logToFile(ss.str());
+            payload = ss.str();
+        }
+
+        // One header for the whole bundle
+        cPacket *msg = pool.acquire("TaskMessage");
+        msg->setByteLength(TASK_HEADER_BYTES + ids.size() + payload.size());
+        pool.addPar(msg, "taskId") = currentTaskId;
+        pool.addPar(msg, "subtaskIds") = ids.c_str();
+        pool.addPar(msg, "data") = payload.c_str();
+
+        sendToServer(msg, serverId);
+        subtaskReplicasSent += subtaskIds.size();
+    }
+
+    // Re-measure the per-task subtask bookkeeping after it changed
+    void accountSubtaskState() {
+        long bytes = subtasks.capacity() * sizeof(SubtaskView) +
+                     subtaskServers.capacity() * sizeof(vector<int>) +
+                     votes.capacity() * sizeof(VoteTracker) +
+                     subtaskDispatchTime.capacity() * sizeof(simtime_t) +
+                     subtaskHedges.capacity() * sizeof(int) +
+                     subtaskDecided.capacity() * sizeof(Trigger *) +
+                     partitionServers.capacity() * sizeof(vector<int>) +
+                     partitionVotes.capacity() * sizeof(VoteTracker) +
+                     partitionReplies.capacity() * sizeof(vector<ReduceReply>) +
+                     nodeResults.capacity() * sizeof(int) +
+                     waitingInputs.capacity() * sizeof(int) +
+                     nodeRanks.capacity() * sizeof(long);
+        for (const vector<int> &servers : subtaskServers) {
+            bytes += servers.capacity() * sizeof(int);
+        }
+        for (const vector<int> &servers : partitionServers) {
+            bytes += servers.capacity() * sizeof(int);
+        }
+        subtaskMemory->replace(subtaskBytes, bytes);
+        subtaskBytes = bytes;
+    }
+
+    // Re-measure the reputation table and the result cache
+    void accountTables() {
+        long bytes = reputation.memoryBytes();
+        reputationMemory->replace(reputationBytes, bytes);
+        reputationBytes = bytes;
+
+        if (resultCache == &localResultCache) {
+            bytes = resultCache->memoryBytes();
+            resultCacheMemory->replace(resultCacheBytes, bytes);
+            resultCacheBytes = bytes;
+        } else if (resultCache != nullptr) {
+            // One cache for all clients: its account is its size
+            resultCacheMemory->replace(resultCacheMemory->current, resultCache->memoryBytes());
+        }
+    }
+
+    // Hedging: each time the subtask misses its deadline it goes to one more server
+    // The trigger lives in this frame, so reassigning subtaskDecided for the
+    // next task cannot leave the watch waiting on a freed one
+    CoTask watchSubtask(int subtaskId) {
+        Trigger decided;
+        subtaskDecided[subtaskId] = &decided;
+        for (;;) {
+            bool fired = co_await decided.wait(hedgeDeadline());
+            if (fired) {
+                break;
+            }
+            subtaskTimeouts++;
+            if (!hedgeSubtask(subtaskId)) {
+                break;
+            }
+        }
+        subtaskDecided[subtaskId] = nullptr;
+    }
+
+    // The configured hedgeQuantile of recent subtask latencies, or hedgeDelay
+    // until enough of them have been observed
+    simtime_t hedgeDeadline() {
+        int window = min((int)subtaskLatencies.size(), HEDGE_WINDOW);
+        if (window < HEDGE_MIN_SAMPLES) {
+            return hedgeDelay;
         }
+        double deadline = latencyQuantile(subtaskLatencies, window, hedgeQuantile);
+        return deadline > 0 ? simtime_t(deadline) : hedgeDelay;
     }
 
-    void sendSubtask(int subtaskId, const vector<int> &data, int serverId) {
-        // Convert data to string
-        stringstream ss;
-        for (int val : data) {
-            ss << val << " ";
+    // Quantile of the last count samples (nearest rank), 0 if there are none
+    static double latencyQuantile(const vector<double> &samples, size_t count, double quantile) {
+        if (count == 0) {
+            return 0;
         }
+        vector<double> recent(samples.end() - count, samples.end());
+        size_t rank = (size_t)ceil(quantile * count);
+        size_t nth = rank > 0 ? rank - 1 : 0;
+        nth_element(recent.begin(), recent.begin() + nth, recent.end());
+        return recent[nth];
+    }
 
-        // Create task message
-        cMessage *msg = new cMessage("TaskMessage");
+    // Send an undecided subtask to the next-best server; false if there is none left to try
+    bool hedgeSubtask(int subtaskId) {
+        PROFILE_SCOPE("Client::hedgeSubtask");
+        if (subtaskHedges[subtaskId] >= maxHedges) {
+            LOG_DEBUG("Client " + to_string(getIndex()) + " subtask " + to_string(subtaskId) + " in task " +
+                      to_string(currentTaskId) + " missed its deadline, no hedges left");
+            return false;
+        }
 
-        // Add taskId parameter
-        msg->addPar("taskId");
-        msg->par("taskId") = currentTaskId;
+        // Next-best server by average score that does not hold the subtask yet
+        vector<int> &selectedServers = subtaskServers[subtaskId];
+        int hedgeServer = -1;
+        for (int serverId : reputation.topServers(numServers)) {
+            if (find(selectedServers.begin(), selectedServers.end(), serverId) == selectedServers.end()) {
+                hedgeServer = serverId;
+                break;
+            }
+        }
+        if (hedgeServer < 0) {
+            LOG_DEBUG("Client " + to_string(getIndex()) + " subtask " + to_string(subtaskId) + " in task " +
+                      to_string(currentTaskId) + " missed its deadline, every server already holds it");
+            return false;
+        }
 
-        msg->addPar("subtaskId");
-        msg->par("subtaskId") = subtaskId;
+        selectedServers.push_back(hedgeServer);
+        subtaskHedges[subtaskId]++;
+        hedgedDispatches++;
+        votes[subtaskId].expectMore(1);
+        reputation.addTaskSubtask(hedgeServer);
+        sendSubtask(subtaskId, hedgeServer, 0, selectedServers.size());
+        accountSubtaskState();
+
+        LOG_INFO("Client " + to_string(getIndex()) + " hedged subtask " + to_string(subtaskId) + " in task " +
+                 to_string(currentTaskId) + " to server " + to_string(hedgeServer) + " after " +
+                 to_string((simTime() - subtaskDispatchTime[subtaskId]).dbl()) + "s");
+        return true;
+    }
 
-        msg->addPar("data");
-        msg->par("data") = ss.str().c_str();
+    // Send on the link to a server, waiting for an ongoing transmission to finish
+    void sendToServer(cPacket *msg, int serverId) {
+        // A replay has no servers; their replies come from the decision log
+        if (replaying) {
+            pool.release(msg);
+            return;
+        }
 
-        // Send to appropriate server
-        send(msg, "out", serverId);
+        taskMessagesSent++;
+        taskPayloadMemory->add(msg->getByteLength());
+        cChannel *channel = gate("out", serverId)->findTransmissionChannel();
+        if (channel == nullptr) {
+            send(msg, "out", serverId);
+            return;
+        }
+        // Fragments of one subtask are sent in the same event, so each one
+        // also waits for those queued before it
+        simtime_t start = max(simTime(), max(channel->getTransmissionFinishTime(), linkFreeAt[serverId]));
+        linkFreeAt[serverId] = start + channel->calculateDuration(msg);
+        if (start > simTime()) {
+            sendDelayed(msg, start - simTime(), "out", serverId);
+        } else {
+            send(msg, "out", serverId);
+        }
     }
 
     void handleResultMessage(cMessage *msg) {
+        PROFILE_SCOPE("Client::handleResultMessage");
         int taskId = msg->par("taskId").longValue();
-        int subtaskId = msg->par("subtaskId").longValue();
-        int result = msg->par("result").longValue();
         int serverId = msg->par("serverId").longValue();
 
-        // Verify this result belongs to our current task
+        resultMessagesReceived++;
+
+        // Verify this result belongs to our current task; a reply to the one
+        // before is still scored, older ones are ignored
         if (taskId != currentTaskId) {
-            delete msg;
-            return; // Ignore results from previous tasks
+            if (taskId == previousTaskId) {
+                scorePreviousTaskReply(msg, serverId);
+            }
+            pool.release(msg);
+            return;
+        }
+
+        bool decided = false;
+        if (msg->hasPar("partition")) {
+            // A reduce partition of a MapReduce job
+            decided = countReduceResult(msg->par("partition").longValue(), serverId, msg->par("counts").stringValue(),
+                                        msg->par("mapScores").stringValue());
+        } else if (msg->hasPar("results")) {
+            // A coalesced reply, format: subtaskId1=result1,subtaskId2=result2,...
+            istringstream results(msg->par("results").stringValue());
+            string token;
+            while (getline(results, token, ',')) {
+                size_t equalsPos = token.find('=');
+                if (equalsPos == string::npos) continue;
+
+                decided |= countResult(stoi(token.substr(0, equalsPos)), stoi(token.substr(equalsPos + 1)), serverId);
+            }
+        } else {
+            int subtaskId = msg->par("subtaskId").longValue();
+
+            // A stolen subtask is credited to the server that actually computed it
+            if (msg->hasPar("stolenFrom")) {
+                moveSubtask(subtaskId, msg->par("stolenFrom").longValue(), serverId);
+            }
+
+            decided = countResult(subtaskId, msg->par("result").longValue(), serverId);
+        }
+
+        // Check if all subtasks (or partitions) have been completed; a
+        // coalesced reply is fully scored first
+        if (decided && (mapReduce ? decidedPartitions == reducePartitions : decidedSubtasks == (int)subtasks.size())) {
+            taskDone.fire();
+        }
+
+        pool.release(msg);
+    }
+
+    // Count one server's result for a subtask of the current task; true if it decided the majority
+    bool countResult(int subtaskId, int result, int serverId) {
+        resultsReceived++;
+
+        // A changed selection policy may not have sent this subtask to the recorded server
+        if (replaying && find(subtaskServers[subtaskId].begin(), subtaskServers[subtaskId].end(), serverId) ==
+                             subtaskServers[subtaskId].end()) {
+            replayDivergences++;
+            return false;
         }
 
         // Log received result
-        string resultMsg = "Client " + to_string(getIndex()) + " received result: " +
-                          to_string(result) + " for subtask " + to_string(subtaskId) +
-                          " from server " + to_string(serverId) + " (task " + to_string(taskId) + ")";
-        logToFile(resultMsg);
+        LOG_DEBUG("Client " + to_string(getIndex()) + " received result: " +
+                  to_string(result) + " for subtask " + to_string(subtaskId) +
+                  " from server " + to_string(serverId) + " (task " + to_string(currentTaskId) + ")");
 
-        // Store result
-        subtaskResults[subtaskId].push_back({serverId, result});
+        // Hedged subtasks mix dispatch times, so they carry no clean rate sample
+        if (subtaskHedges[subtaskId] == 0) {
+            updateThroughput(serverId, subtaskId);
+        }
 
-        // Check if we have received all results for this subtask
-        if (subtaskResults[subtaskId].size() >= numServers / 2 + 1) {
+        // Count the vote; the majority is decided once it can no longer be overtaken
+        VoteTracker &vote = votes[subtaskId];
+        if (vote.isDecided()) {
+            scoreLateReply(currentTaskId, subtaskId, serverId, result == vote.getMajority());
+        } else if (vote.add(serverId, result)) {
             // Determine majority result
             processMajorityResult(subtaskId);
+            return true;
+        }
+        return false;
+    }
 
-            // Check if all subtasks have been completed
-            if (majorityResults.size() == subtasks.size()) {
-                // All subtasks completed, compute final result
-                computeFinalResult();
+    // Count one reduce replica's counts for a partition; true if it decided the majority
+    bool countReduceResult(int partition, int serverId, const string &counts, const string &mapScores) {
+        resultsReceived++;
 
-                // Broadcast server scores via gossip
-                broadcastScores();
+        LOG_DEBUG("Client " + to_string(getIndex()) + " received counts for partition " + to_string(partition) +
+                  " from server " + to_string(serverId) + " (task " + to_string(currentTaskId) + "): " + counts);
 
-                // Schedule next task or end simulation
-                if (tasksCompleted < 2) {  // We need to run two tasks as per the assignment
-                    // Log completion of the current task
-                    logToFile("Client " + to_string(getIndex()) + " completed task " + to_string(currentTaskId) +
-                                " and will start the next task soon");
+        VoteTracker &vote = partitionVotes[partition];
+        vector<ReduceReply> &replies = partitionReplies[partition];
+        if (vote.isDecided()) {
+            // A late reply is scored directly against the kept majority
+            if (counts == replies.front().counts) {
+                reputation.addTaskScore(serverId, 1);
+            }
+            return false;
+        }
 
-                    // Schedule another task
-                    scheduleAt(simTime() + 2.0, new cMessage("StartTask"));
-                } else {
-                    // Log simulation end
-                    logToFile("Client " + to_string(getIndex()) + " has completed all tasks");
-                }
+        // Vote on the index of the counts among the distinct replies, so only
+        // identical counts agree
+        int candidate = 0;
+        while (candidate < (int)replies.size() && replies[candidate].counts != counts) {
+            candidate++;
+        }
+        if (candidate == (int)replies.size()) {
+            replies.push_back(ReduceReply{counts, mapScores});
+        }
+        if (!vote.add(serverId, candidate)) {
+            return false;
+        }
+        processPartitionMajority(partition);
+        return true;
+    }
+
+    void processPartitionMajority(int partition) {
+        PROFILE_SCOPE("Client::vote");
+        VoteTracker &vote = partitionVotes[partition];
+        vector<ReduceReply> &replies = partitionReplies[partition];
+        const ReduceReply &majority = replies[vote.getMajority()];
+
+        // Partitions hold disjoint keys, so merging is a union
+        MapReduce::addFormattedCounts(majority.counts, jobCounts);
+        decidedPartitions++;
+        partitionLatencyStats.collect((simTime() - taskStartTime).dbl());
+
+        // Reduce replicas that agreed score like subtask replicas
+        vote.forEachPendingReply([&](int serverId, bool agreed) {
+            if (agreed) {
+                reputation.addTaskScore(serverId, 1);
             }
+        });
+        vote.clearPending();
+
+        // Map replicas are judged by the majority reducers, once per partition;
+        // one that reached them after the map majority is neither counted nor scored
+        istringstream scores(majority.mapScores);
+        string token;
+        while (getline(scores, token, ',')) {
+            size_t equalsPos = token.find('=');
+            if (equalsPos == string::npos) continue;
+
+            int serverId = stoi(token.substr(0, equalsPos));
+            reputation.addTaskSubtask(serverId);
+            reputation.addTaskScore(serverId, stoi(token.substr(equalsPos + 1)));
         }
 
-        delete msg;
+        LOG_DEBUG("Client " + to_string(getIndex()) + " determined majority counts for partition " +
+                  to_string(partition) + " in task " + to_string(currentTaskId) + " after " +
+                  to_string(vote.getReceived()) + " of " + to_string(vote.getExpected()) + " replies");
+
+        // Only the majority counts are kept, to score late replies
+        ReduceReply kept{std::move(replies[vote.getMajority()].counts), ""};
+        replies.assign(1, std::move(kept));
+        accountTables();
     }
 
-    void processMajorityResult(int subtaskId) {
-        // Count occurrences of each result
-        unordered_map<int, int> resultCount;
-        unordered_map<int, vector<int>> resultToServers;
+    void handleAggregateMessage(cMessage *msg) {
+        PROFILE_SCOPE("Client::handleAggregateMessage");
+        int taskId = msg->par("taskId").longValue();
+        int result = msg->par("result").longValue();
+        int subtaskCount = msg->par("subtaskCount").longValue();
 
-        for (auto &p : subtaskResults[subtaskId]) {
-            int serverId = p.first;
-            int result = p.second;
+        aggregateMessagesReceived++;
 
-            resultCount[result]++;
-            resultToServers[result].push_back(serverId);
+        if (taskId != currentTaskId) {
+            pool.release(msg);
+            return; // Ignore aggregates from previous tasks
         }
 
-        // Find result with majority
-        int majorityResult = -1;
-        int maxCount = 0;
+        LOG_DEBUG("Client " + to_string(getIndex()) + " received aggregate result: " + to_string(result) +
+                  " covering " + to_string(subtaskCount) + " subtasks (task " + to_string(taskId) + ")");
+
+        // Format: subtaskId1=majority1,subtaskId2=majority2,...
+        istringstream majorities(msg->par("majorities").stringValue());
+        string token;
+        while (getline(majorities, token, ',')) {
+            size_t equalsPos = token.find('=');
+            if (equalsPos == string::npos) continue;
+
+            int subtaskId = stoi(token.substr(0, equalsPos));
+            int majorityResult = stoi(token.substr(equalsPos + 1));
+            if (votes[subtaskId].isDecided()) {
+                continue;
+            }
+            votes[subtaskId].settle(majorityResult);
+            foldMajority(subtaskId, majorityResult);
+            subtaskLatencyStats.collect((simTime() - subtaskDispatchTime[subtaskId]).dbl());
+            trackInFlight(-1);
 
-        for (auto &p : resultCount) {
-            if (p.second > maxCount) {
-                maxCount = p.second;
-                majorityResult = p.first;
+            if (resultCache != nullptr) {
+                resultCache->insert(subtaskData(subtaskId), subtasks[subtaskId].length, KERNEL_MAX, majorityResult);
             }
         }
 
-        // Store majority result
-        majorityResults[subtaskId] = majorityResult;
+        // Format: serverId1=correctResults1,serverId2=correctResults2,...
+        istringstream scores(msg->par("scores").stringValue());
+        while (getline(scores, token, ',')) {
+            size_t equalsPos = token.find('=');
+            if (equalsPos == string::npos) continue;
+
+            int serverId = stoi(token.substr(0, equalsPos));
+            reputation.addTaskScore(serverId, stoi(token.substr(equalsPos + 1)));
+        }
+
+        if (decidedSubtasks == (int)subtasks.size()) {
+            taskDone.fire();
+        }
+
+        accountTables();
+        pool.release(msg);
+    }
 
-        // Update server scores
-        for (auto &p : subtaskResults[subtaskId]) {
-            int serverId = p.first;
-            int result = p.second;
+    void moveSubtask(int subtaskId, int fromServer, int toServer) {
+        vector<int> &servers = subtaskServers[subtaskId];
+        auto it = find(servers.begin(), servers.end(), fromServer);
+        if (it == servers.end()) {
+            return;
+        }
+        *it = toServer;
+        reputation.moveTaskSubtask(fromServer, toServer);
+        stolenResults++;
+
+        LOG_DEBUG("Client " + to_string(getIndex()) + " subtask " + to_string(subtaskId) + " in task " +
+                  to_string(currentTaskId) + " was stolen from server " + to_string(fromServer) +
+                  " by server " + to_string(toServer));
+    }
 
-            // If server provided correct (majority) result, increment its score
-            if (result == majorityResult) {
-                serverTracking[serverId].score++;
+    void completeTask() {
+        taskLatencyStats.collect((simTime() - taskStartTime).dbl());
+        cacheHitStats.collect(taskCacheHits);
+        lastTaskCompleted = simTime();
+
+        // Mean subtasks in flight over the task
+        if (!taskGraph.isEmpty() && simTime() > taskStartTime) {
+            trackInFlight(0);
+            dagParallelismStats.collect(inFlightArea / (simTime() - taskStartTime).dbl());
+        }
+
+        // All subtasks completed, compute final result
+        computeFinalResult();
+
+        previousTaskId = currentTaskId;
+        previousResults = nodeResults;
+        if (mapReduce) {
+            previousCounts.resize(reducePartitions);
+            for (int partition = 0; partition < reducePartitions; partition++) {
+                previousCounts[partition] = partitionReplies[partition].front().counts;
             }
         }
 
+        // Broadcast server scores via gossip
+        broadcastScores();
+    }
+
+    void processMajorityResult(int subtaskId) {
+        PROFILE_SCOPE("Client::vote");
+        VoteTracker &vote = votes[subtaskId];
+        int majorityResult = vote.getMajority();
+
+        // Fold the majority into the running task result
+        foldMajority(subtaskId, majorityResult);
+
+        double latency = (simTime() - subtaskDispatchTime[subtaskId]).dbl();
+        subtaskLatencyStats.collect(latency);
+        subtaskLatencies.push_back(latency);
+        if (subtaskHedges[subtaskId] > 0) {
+            hedgedSubtaskLatencyStats.collect(latency);
+        }
+
+        // Remember the verified result for repeated payloads
+        if (isCacheable(subtaskId)) {
+            resultCache->insert(subtaskData(subtaskId), subtasks[subtaskId].length, KERNEL_MAX, majorityResult);
+            accountTables();
+        }
+
         // Log majority result
-        string majorityMsg = "Client " + to_string(getIndex()) + " determined majority result: " +
-                            to_string(majorityResult) + " for subtask " + to_string(subtaskId) +
-                            " in task " + to_string(currentTaskId);
-        logToFile(majorityMsg);
-
-        // Log honest and malicious servers
-        stringstream honestSs, maliciousSs;
-        honestSs << "Honest servers for subtask " << subtaskId << " in task " << currentTaskId << ": ";
-        maliciousSs << "Malicious servers for subtask " << subtaskId << " in task " << currentTaskId << ": ";
-
-        for (auto &p : subtaskResults[subtaskId]) {
-            int serverId = p.first;
-            int result = p.second;
-
-            if (result == majorityResult) {
-                honestSs << serverId << " ";
-            } else {
-                maliciousSs << serverId << " ";
+        LOG_DEBUG("Client " + to_string(getIndex()) + " determined majority result: " +
+                  to_string(majorityResult) + " for subtask " + to_string(subtaskId) +
+                  " in task " + to_string(currentTaskId) + " after " + to_string(vote.getReceived()) +
+                  " of " + to_string(vote.getExpected()) + " replies");
+
+        // Log the honest and malicious servers among the replies so far
+        if (LOG_ENABLED(DEBUG)) {
+            stringstream honestSs, maliciousSs;
+            honestSs << "Honest servers for subtask " << subtaskId << " in task " << currentTaskId << ": ";
+            maliciousSs << "Malicious servers for subtask " << subtaskId << " in task " << currentTaskId << ": ";
+            vote.forEachPendingReply([&](int serverId, bool agreed) {
+                (agreed ? honestSs : maliciousSs) << serverId << " ";
+            });
+            logToFile(honestSs.str());
+            logToFile(maliciousSs.str());
+        }
+
+        // If a server provided the correct (majority) result, increment its score
+        vote.forEachPendingReply([&](int serverId, bool agreed) {
+            if (agreed) {
+                reputation.addTaskScore(serverId, 1);
+            }
+        });
+        vote.clearPending();
+
+        // Ends the subtask's hedging watch
+        if (subtaskDecided[subtaskId] != nullptr) {
+            subtaskDecided[subtaskId]->fire();
+        }
+        trackInFlight(-1);
+
+        // The result may complete the inputs of later subtasks
+        vector<int> ready;
+        releaseSuccessors(subtaskId, ready);
+        if (!ready.empty()) {
+            dispatchReady(ready);
+            accountSubtaskState();
+        }
+    }
+
+    // A reply that arrived after its subtask was decided is scored directly
+    void scoreLateReply(int taskId, int subtaskId, int serverId, bool agreed) {
+        PROFILE_SCOPE("Client::vote");
+        if (agreed) {
+            reputation.addTaskScore(serverId, 1);
+        }
+
+        LOG_DEBUG("Client " + to_string(getIndex()) + " scored late reply from server " + to_string(serverId) +
+                  " for subtask " + to_string(subtaskId) + " in task " + to_string(taskId) +
+                  (agreed ? ": honest" : ": malicious"));
+    }
+
+    // A reply to the previous task that arrived after the next one started;
+    // its score goes out with the current task's commit
+    void scorePreviousTaskReply(cMessage *msg, int serverId) {
+        if (msg->hasPar("partition")) {
+            int partition = msg->par("partition").longValue();
+            scoreLateReply(previousTaskId, partition, serverId, previousCounts[partition] == msg->par("counts").stringValue());
+        } else if (msg->hasPar("results")) {
+            istringstream results(msg->par("results").stringValue());
+            string token;
+            while (getline(results, token, ',')) {
+                size_t equalsPos = token.find('=');
+                if (equalsPos == string::npos) continue;
+
+                int subtaskId = stoi(token.substr(0, equalsPos));
+                scoreLateReply(previousTaskId, subtaskId, serverId,
+                               previousResults[subtaskId] == stoi(token.substr(equalsPos + 1)));
             }
+        } else if (!msg->hasPar("stolenFrom")) {
+            // A stolen subtask was counted for its victim when the task was committed
+            int subtaskId = msg->par("subtaskId").longValue();
+            scoreLateReply(previousTaskId, subtaskId, serverId,
+                           previousResults[subtaskId] == msg->par("result").longValue());
         }
+    }
 
-        logToFile(honestSs.str());
-        logToFile(maliciousSs.str());
+    void foldMajority(int subtaskId, int majorityResult) {
+        // For finding max element, the task result is the max of all subtask results
+        finalResult = max(finalResult, majorityResult);
+        nodeResults[subtaskId] = majorityResult;
+        decidedSubtasks++;
     }
 
     void computeFinalResult() {
-        // For finding max element, take max of all subtask results
-        finalResult = INT_MIN;
-        for (auto &p : majorityResults) {
-            finalResult = max(finalResult, p.second);
+        if (mapReduce) {
+            // Word count: the most frequent value is the task's result
+            long elements = 0;
+            long occurrences = 0;
+            for (const auto &entry : jobCounts) {
+                elements += entry.second;
+                if (entry.second > occurrences) {
+                    occurrences = entry.second;
+                    finalResult = entry.first;
+                }
+            }
+            LOG_INFO("Client " + to_string(getIndex()) + " computed word count for task " + to_string(currentTaskId) +
+                     ": " + to_string(jobCounts.size()) + " distinct values over " + to_string(elements) +
+                     " elements, most frequent " + to_string(finalResult) + " (" + to_string(occurrences) + " times)");
+        } else {
+            // Log final result
+            LOG_INFO("Client " + to_string(getIndex()) + " computed final result: " +
+                     to_string(finalResult) + " for task " + to_string(currentTaskId));
         }
 
-        // Log final result
-        string finalMsg = "Client " + to_string(getIndex()) + " computed final result: " +
-                         to_string(finalResult) + " for task " + to_string(currentTaskId);
-        logToFile(finalMsg);
-
         // Log server tracking information
-        for (int i = 0; i < numServers; i++) {
+        for (int row = 0; row < reputation.rows() && LOG_ENABLED(DEBUG); row++) {
+            int score = reputation.getTaskScore(row);
+            int subtaskCount = reputation.getTaskCount(row);
+
             stringstream ss;
-            ss << "Client " << getIndex() << " server " << i << " tracking for task " << currentTaskId
-               << ": Score=" << serverTracking[i].score
-               << ", SubtaskCount=" << serverTracking[i].subtaskCount;
+            ss << "Client " << getIndex() << " server " << reputation.serverAt(row) << " tracking for task " << currentTaskId
+               << ": Score=" << score
+               << ", SubtaskCount=" << subtaskCount;
 
             // Calculate rate if subtasks were assigned
-            if (serverTracking[i].subtaskCount > 0) {
-                double rate = (double)serverTracking[i].score / serverTracking[i].subtaskCount;
+            if (subtaskCount > 0) {
+                double rate = (double)score / subtaskCount;
                 ss << ", Rate=" << fixed << setprecision(2) << rate;
             } else {
                 ss << ", Rate=N/A (no subtasks assigned)";
@@ -424,95 +1731,181 @@ protected:
     }
 
     void broadcastScores() {
-        // Create score message with the server tracking information
-        string scoreStr = to_string(getIndex()) + ":";
-
-        for (int i = 0; i < numServers; i++) {
-            // Format: serverId=score:subtaskCount
-            scoreStr += to_string(i) + "=" + to_string(serverTracking[i].score) +
-                       ":" + to_string(serverTracking[i].subtaskCount);
+        PROFILE_SCOPE("Client::broadcastScores");
+        // Fold this task into our own counters and gossip all of them, so a
+        // lost broadcast is repaired by the next one
+        int origin = getIndex();
+        reputation.commitTask(origin);
+
+        string scoreStr = to_string(origin) + ":";
+
+        bool first = true;
+        for (int row = 0; row < reputation.rows(); row++) {
+            // Servers this client never used have nothing to report
+            if (reputation.getOriginCount(origin, row) == 0) {
+                continue;
+            }
 
-            if (i < numServers - 1) {
+            if (!first) {
                 scoreStr += ",";
             }
+            first = false;
+
+            // Format: serverId=cumulativeScore:cumulativeSubtaskCount
+            scoreStr += to_string(reputation.serverAt(row)) + "=" + to_string(reputation.getOriginScore(origin, row)) +
+                       ":" + to_string(reputation.getOriginCount(origin, row));
         }
 
         // Create gossip message
-        cMessage *gossip = new cMessage("GossipMessage");
-        gossip->addPar("timestamp");
-        gossip->par("timestamp") = simTime().dbl();
-
-        gossip->addPar("score");
-        gossip->par("score") = scoreStr.c_str();
-
-        gossip->addPar("taskNumber");
-        gossip->par("taskNumber") = currentTaskId;
-
-        // Format for message log
-        string msgKey = to_string(simTime().dbl()) + ":" + to_string(getIndex()) + ":" + scoreStr;
-        messageLog[msgKey] = true;
+        cMessage *gossip = pool.acquire("GossipMessage");
+        pool.addPar(gossip, "timestamp") = simTime().dbl();
+        pool.addPar(gossip, "score") = scoreStr.c_str();
+        pool.addPar(gossip, "taskNumber") = currentTaskId;
 
         // Log gossip message
-        string gossipMsg = "Client " + to_string(getIndex()) + " broadcasting scores for task " +
-                          to_string(currentTaskId) + ": " + scoreStr;
-        logToFile(gossipMsg);
+        LOG_DEBUG("Client " + to_string(getIndex()) + " broadcasting scores for task " +
+                  to_string(currentTaskId) + ": " + scoreStr);
 
-        // Send to all connected clients
-        for (int i = 0; i < gateSize("gout"); i++) {
-            cMessage *copy = gossip->dup();
+        // Send to all connected clients; a replay has its gossip in the decision log
+        for (int i = 0; i < gateSize("gout") && !replaying; i++) {
+            cMessage *copy = pool.copy(gossip);
             send(copy, "gout", i);
+            (*gossipInFlight)++;
+            gossipMemory->add(scoreStr.size() + 1);
         }
 
-        delete gossip;
+        pool.release(gossip);
     }
 
     void handleGossipMessage(cMessage *msg) {
+        PROFILE_SCOPE("Client::handleGossipMessage");
         double timestamp = msg->par("timestamp").doubleValue();
         string scoreStr = msg->par("score").stringValue();
         int taskNumber = 1;  // Default to task 1
+        int arrivalGate = arrivalGateOf(msg);
 
         // Check if taskNumber parameter exists
         if (msg->hasPar("taskNumber")) {
             taskNumber = msg->par("taskNumber").longValue();
         }
 
-        // Create message key
-        string msgKey = to_string(timestamp) + ":" + scoreStr;
-
-        // Check if this message has been seen before
-        if (messageLog.find(msgKey) != messageLog.end()) {
-            // Already seen this message, ignore
-            delete msg;
+        // Log received gossip
+        LOG_DEBUG("Client " + to_string(getIndex()) + " received gossip for task " +
+                  to_string(taskNumber) + ": " + to_string(timestamp) + ":" + scoreStr +
+                  " from gate " + to_string(arrivalGate));
+
+        // Merge the scores; gossip that was already known (a duplicate, or
+        // older than what arrived on another path) stops here
+        if (!processReceivedScores(scoreStr, taskNumber)) {
+            gossipStale++;
+            pool.release(msg);
             return;
         }
-
-        // Mark message as seen
-        messageLog[msgKey] = true;
-
-        // Log received gossip
-        string gossipLog = "Client " + to_string(getIndex()) + " received gossip for task " +
-                          to_string(taskNumber) + ": " + to_string(timestamp) + ":" + scoreStr +
-                          " from gate " + to_string(msg->getArrivalGate()->getIndex());
-        logToFile(gossipLog);
+        accountTables();
 
         // Forward to other clients
-        for (int i = 0; i < gateSize("gout"); i++) {
-            if (i != msg->getArrivalGate()->getIndex()) {
-                cMessage *copy = msg->dup();
+        for (int i = 0; i < gateSize("gout") && !replaying; i++) {
+            if (i != arrivalGate) {
+                cMessage *copy = pool.copy(msg);
                 send(copy, "gout", i);
+                (*gossipInFlight)++;
+                gossipMemory->add(scoreStr.size() + 1);
             }
         }
 
-        // Process the scores
-        processReceivedScores(scoreStr, taskNumber);
+        pool.release(msg);
+    }
 
-        delete msg;
+    // Gate index of a gossip message; replayed ones carry the recorded index
+    static int arrivalGateOf(cMessage *msg) {
+        if (msg->hasPar("replayGate")) {
+            return msg->par("replayGate").longValue();
+        }
+        return msg->getArrivalGate()->getIndex();
     }
 
-    void processReceivedScores(const string &scoreStr, int taskNumber) {
+    void recordArrival(cMessage *msg) {
+        int64_t time = simTime().raw();
+        if (strcmp(msg->getName(), "ResultMessage") == 0 && msg->hasPar("results")) {
+            // A coalesced reply is recorded as one result per subtask
+            istringstream results(msg->par("results").stringValue());
+            string token;
+            while (getline(results, token, ',')) {
+                size_t equalsPos = token.find('=');
+                if (equalsPos == string::npos) continue;
+
+                decisionWriter->result(time, msg->par("taskId").longValue(), stoi(token.substr(0, equalsPos)),
+                                       msg->par("serverId").longValue(), stoi(token.substr(equalsPos + 1)), -1);
+            }
+        } else if (strcmp(msg->getName(), "ResultMessage") == 0) {
+            decisionWriter->result(time, msg->par("taskId").longValue(), msg->par("subtaskId").longValue(),
+                                   msg->par("serverId").longValue(), msg->par("result").longValue(),
+                                   msg->hasPar("stolenFrom") ? msg->par("stolenFrom").longValue() : -1);
+        } else if (strcmp(msg->getName(), "AggregateMessage") == 0) {
+            decisionWriter->aggregate(time, msg->par("taskId").longValue(), msg->par("result").longValue(),
+                                      msg->par("subtaskCount").longValue(), msg->par("majorities").stringValue(),
+                                      msg->par("scores").stringValue());
+        } else if (strcmp(msg->getName(), "GossipMessage") == 0) {
+            decisionWriter->gossip(time, msg->getArrivalGate()->getIndex(),
+                                   msg->hasPar("taskNumber") ? msg->par("taskNumber").longValue() : 1,
+                                   msg->par("timestamp").doubleValue(), msg->par("score").stringValue());
+        }
+    }
+
+    // Read a recorded run: its seed, its task data, and its arrivals, which are
+    // scheduled as self-messages at their recorded times
+    DatasetSource *loadDecisionLog(const string &path, unsigned int &seed) {
+        DecisionLogReader reader(path);
+        if (reader.clientId != getIndex()) {
+            throw cRuntimeError("Decision log %s was recorded by client %d", path.c_str(), reader.clientId);
+        }
+        seed = (unsigned int)reader.seed;
+
+        ReplayDatasetSource *source = new ReplayDatasetSource();
+        DecisionRecord record;
+        while (reader.next(record)) {
+            cPacket *msg = nullptr;
+            switch (record.type) {
+            case RECORD_TASK:
+                source->addTask(record.taskId, record.data);
+                continue;
+            case RECORD_RESULT:
+                msg = pool.acquire("ResultMessage");
+                pool.addPar(msg, "taskId") = record.taskId;
+                pool.addPar(msg, "subtaskId") = record.subtaskId;
+                pool.addPar(msg, "result") = record.result;
+                pool.addPar(msg, "serverId") = record.serverId;
+                if (record.stolenFrom >= 0) {
+                    pool.addPar(msg, "stolenFrom") = record.stolenFrom;
+                }
+                break;
+            case RECORD_AGGREGATE:
+                msg = pool.acquire("AggregateMessage");
+                pool.addPar(msg, "taskId") = record.taskId;
+                pool.addPar(msg, "result") = record.result;
+                pool.addPar(msg, "subtaskCount") = record.subtaskCount;
+                pool.addPar(msg, "majorities") = record.text.c_str();
+                pool.addPar(msg, "scores") = record.scores.c_str();
+                break;
+            case RECORD_GOSSIP:
+                msg = pool.acquire("GossipMessage");
+                pool.addPar(msg, "timestamp") = record.timestamp;
+                pool.addPar(msg, "score") = record.text.c_str();
+                pool.addPar(msg, "taskNumber") = record.taskId;
+                pool.addPar(msg, "replayGate") = record.gate;
+                break;
+            }
+            scheduleAt(SimTime::fromRaw(record.time), msg);
+        }
+        return source;
+    }
+
+    // Merge an origin's cumulative counters; false if none of them was new
+    bool processReceivedScores(const string &scoreStr, int taskNumber) {
+        PROFILE_SCOPE("Client::parse");
         // Parse score string - format: clientId:serverId1=score1:subtaskCount1,serverId2=score2:subtaskCount2,...
         size_t colonPos = scoreStr.find(':');
-        if (colonPos == string::npos) return;
+        if (colonPos == string::npos) return false;
 
         int clientId = stoi(scoreStr.substr(0, colonPos));
         string scoresSection = scoreStr.substr(colonPos + 1);
@@ -520,6 +1913,7 @@ protected:
         // Parse individual server scores
         istringstream ss(scoresSection);
         string token;
+        bool changed = false;
 
         while (getline(ss, token, ',')) {
             size_t equalsPos = token.find('=');
@@ -532,31 +1926,31 @@ protected:
             int score = stoi(token.substr(equalsPos + 1, colonPos - equalsPos - 1));
             int subtaskCount = stoi(token.substr(colonPos + 1));
 
-            // Add to aggregated tracking
-            aggregatedServerTracking[serverId].score += score;
-            aggregatedServerTracking[serverId].subtaskCount += subtaskCount;
-
-            // Recalculate average score using the new formula
-            if (aggregatedServerTracking[serverId].subtaskCount > 0) {
-                serverAvgScores[serverId] = (double)aggregatedServerTracking[serverId].score /
-                                        aggregatedServerTracking[serverId].subtaskCount;
-            } else {
-                serverAvgScores[serverId] = 0.0;
+            // Merge with max into the origin's counter and recalculate the average score
+            if (reputation.mergeOrigin(clientId, serverId, score, subtaskCount)) {
+                changed = true;
             }
         }
+        if (!changed) {
+            return false;
+        }
 
         // Log updated average scores
-        stringstream avgSs;
-        avgSs << "Client " << getIndex() << " updated average scores after task " << taskNumber << ": ";
-        for (int i = 0; i < numServers; i++) {
-            avgSs << i << ":" << fixed << setprecision(2) << serverAvgScores[i]
-                  << " (Score=" << aggregatedServerTracking[i].score
-                  << ", Tasks=" << aggregatedServerTracking[i].subtaskCount << ") ";
+        if (LOG_ENABLED(DEBUG)) {
+            stringstream avgSs;
+            avgSs << "Client " << getIndex() << " updated average scores after task " << taskNumber << ": ";
+            for (int row = 0; row < reputation.rows(); row++) {
+                avgSs << reputation.serverAt(row) << ":" << fixed << setprecision(2) << reputation.getAvgScore(row)
+                      << " (Score=" << reputation.getTotalScore(row)
+                      << ", Tasks=" << reputation.getTotalCount(row) << ") ";
+            }
+            logToFile(avgSs.str());
         }
-        logToFile(avgSs.str());
+        return true;
     }
 
     void logToFile(const string &message) {
+        PROFILE_SCOPE("Client::log");
         // Get current time
         time_t now = time(nullptr);
         tm *ltm = localtime(&now);
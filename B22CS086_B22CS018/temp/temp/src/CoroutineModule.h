@@ -0,0 +1,320 @@
+#ifndef COROUTINEMODULE_H
+#define COROUTINEMODULE_H
+
+#include <omnetpp.h>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+// C++20 coroutines on top of cSimpleModule, so that a protocol can be
+// written as sequential code instead of a state machine spread over
+// handleMessage branches:
+//
+//   CoTask runTask() {
+//       dispatch();
+//       bool decided = co_await quorum.wait(deadline);
+//       if (!decided) { ...timed out... }
+//       combine();
+//   }
+//
+// Keep co_await out of if, while and for conditions, as above: GCC 12.2
+// resumes such a coroutine with a corrupt frame, even for a plain
+// `if (co_await trigger.wait())`. Assigning the result to a local works.
+//
+// CoTask coroutines must be member functions of a CoroutineModule. They start
+// running when called and suspend only at a co_await. They either run
+// detached with spawn() or are awaited by another CoTask. Waiting costs the
+// coroutine frame and, with a timeout, one self-message named "Resume", which
+// the module passes to resume(). A Trigger resumes its waiter synchronously,
+// inside the handler that fires it, so event order is the same as with plain
+// callbacks. Exceptions propagate to the awaiting coroutine and, from a
+// spawned one, out of the handler that resumed it.
+
+class CoroutineModule;
+class Trigger;
+class SleepAwaiter;
+class TriggerAwaiter;
+
+// A suspended co_await: the coroutine to resume and its pending timer, if any
+struct CoroutineWaiter {
+    CoroutineModule *host;
+    std::coroutine_handle<> handle;
+    omnetpp::cMessage *timer;
+    Trigger *trigger; // being waited on, cleared when it fires or times out
+
+    CoroutineWaiter() : host(nullptr), timer(nullptr), trigger(nullptr) {}
+};
+
+class CoTask {
+public:
+    struct FinalAwaiter;
+
+    struct promise_type {
+        CoroutineModule *host;
+        std::coroutine_handle<> continuation; // the awaiting coroutine, if any
+        std::exception_ptr exception;
+
+        // The implicit object argument of a member coroutine (a template, as
+        // GCC does not match it against a base class reference)
+        template <typename Module, typename... Args>
+        promise_type(Module &host, Args &&...) : host(&host) {}
+
+        CoTask get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    // Continue the awaiting coroutine when this one finishes
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    // co_await on a CoTask waits for it to finish
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() { return handle.done(); }
+        void await_suspend(std::coroutine_handle<> awaiting) { handle.promise().continuation = awaiting; }
+        void await_resume() {
+            if (handle.promise().exception) {
+                std::rethrow_exception(handle.promise().exception);
+            }
+        }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+public:
+    explicit CoTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    CoTask(CoTask &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    CoTask(const CoTask &) = delete;
+
+    CoTask &operator=(CoTask &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    // Destroys the frame, and with it any timer the coroutine still holds
+    ~CoTask() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool done() const { return handle.done(); }
+    std::exception_ptr exception() const { return handle.promise().exception; }
+
+    Awaiter operator co_await() && { return Awaiter{handle}; }
+};
+
+// One-shot condition a single coroutine can wait on, with an optional timeout.
+// The waiter keeps its address, so a Trigger must not be copied or moved while
+// a coroutine waits on it: keep it in a member or in the waiting coroutine.
+class Trigger {
+private:
+    friend class CoroutineModule;
+    friend class TriggerAwaiter;
+
+    bool fired;
+    CoroutineWaiter *waiter;
+
+public:
+    Trigger() : fired(false), waiter(nullptr) {}
+    Trigger(const Trigger &) = delete;
+    Trigger &operator=(const Trigger &) = delete;
+
+    // Resumes the waiter, if any, before returning. The waiter may destroy the
+    // trigger, so nothing touches it after the resume
+    inline void fire();
+
+    void reset() { fired = false; }
+    bool isFired() const { return fired; }
+
+    // co_await yields true once fired, false when the timeout (if >= 0) expires first
+    inline TriggerAwaiter wait(omnetpp::simtime_t timeout = -1);
+};
+
+class CoroutineModule : public omnetpp::cSimpleModule {
+private:
+    friend class Trigger;
+    friend class SleepAwaiter;
+    friend class TriggerAwaiter;
+
+    std::vector<CoTask> detached;
+    std::vector<omnetpp::cMessage *> idleTimers;
+
+    void armTimer(CoroutineWaiter *waiter, omnetpp::simtime_t delay) {
+        omnetpp::cMessage *timer;
+        if (idleTimers.empty()) {
+            timer = new omnetpp::cMessage("Resume");
+        } else {
+            timer = idleTimers.back();
+            idleTimers.pop_back();
+        }
+        timer->setContextPointer(waiter);
+        waiter->timer = timer;
+        scheduleAt(omnetpp::simTime() + delay, timer);
+    }
+
+    void disarmTimer(CoroutineWaiter *waiter) {
+        if (waiter->timer->isScheduled()) {
+            cancelEvent(waiter->timer);
+        }
+        idleTimers.push_back(waiter->timer);
+        waiter->timer = nullptr;
+    }
+
+    void wake(CoroutineWaiter *waiter) {
+        if (waiter->timer != nullptr) {
+            disarmTimer(waiter);
+        }
+        waiter->handle.resume();
+        reap();
+    }
+
+    // Drop finished detached coroutines and rethrow what they failed with
+    void reap() {
+        for (size_t i = 0; i < detached.size();) {
+            if (!detached[i].done()) {
+                i++;
+                continue;
+            }
+            std::exception_ptr exception = detached[i].exception();
+            detached.erase(detached.begin() + i);
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    }
+
+public:
+    // Suspended coroutines are destroyed with the module
+    ~CoroutineModule() {
+        detached.clear();
+        for (omnetpp::cMessage *timer : idleTimers) {
+            delete timer;
+        }
+    }
+
+protected:
+    // Run a coroutine without waiting for it; it lives until it finishes
+    void spawn(CoTask task) {
+        if (!task.done()) {
+            detached.push_back(std::move(task));
+        } else if (task.exception()) {
+            std::rethrow_exception(task.exception());
+        }
+    }
+
+    // Continue the coroutine whose "Resume" timer this is
+    void resume(omnetpp::cMessage *timer) {
+        CoroutineWaiter *waiter = static_cast<CoroutineWaiter *>(timer->getContextPointer());
+        waiter->timer = nullptr;
+        idleTimers.push_back(timer);
+        if (waiter->trigger != nullptr) {
+            waiter->trigger->waiter = nullptr; // Timed out
+            waiter->trigger = nullptr;
+        }
+        waiter->handle.resume();
+        reap();
+    }
+
+    inline SleepAwaiter sleep(omnetpp::simtime_t delay);
+};
+
+class SleepAwaiter {
+private:
+    CoroutineWaiter waiter;
+    omnetpp::simtime_t delay;
+
+public:
+    explicit SleepAwaiter(omnetpp::simtime_t delay) : delay(delay) {}
+    SleepAwaiter(const SleepAwaiter &) = delete;
+
+    ~SleepAwaiter() {
+        if (waiter.timer != nullptr) {
+            waiter.host->disarmTimer(&waiter);
+        }
+    }
+
+    bool await_ready() { return false; }
+
+    void await_suspend(std::coroutine_handle<CoTask::promise_type> handle) {
+        waiter.host = handle.promise().host;
+        waiter.handle = handle;
+        waiter.host->armTimer(&waiter, delay);
+    }
+
+    void await_resume() {}
+};
+
+class TriggerAwaiter {
+private:
+    Trigger *trigger;
+    omnetpp::simtime_t timeout;
+    CoroutineWaiter waiter;
+
+public:
+    TriggerAwaiter(Trigger *trigger, omnetpp::simtime_t timeout) : trigger(trigger), timeout(timeout) {}
+    TriggerAwaiter(const TriggerAwaiter &) = delete;
+
+    // Only the timer is released here: the trigger may already be gone when
+    // the module destroys a suspended coroutine
+    ~TriggerAwaiter() {
+        if (waiter.timer != nullptr) {
+            waiter.host->disarmTimer(&waiter);
+        }
+    }
+
+    bool await_ready() { return trigger->fired; }
+
+    void await_suspend(std::coroutine_handle<CoTask::promise_type> handle) {
+        if (trigger->waiter != nullptr) {
+            throw omnetpp::cRuntimeError("Trigger already has a waiting coroutine");
+        }
+        waiter.host = handle.promise().host;
+        waiter.handle = handle;
+        waiter.trigger = trigger;
+        trigger->waiter = &waiter;
+        if (timeout >= SIMTIME_ZERO) {
+            waiter.host->armTimer(&waiter, timeout);
+        }
+    }
+
+    // Fired, either before the co_await or while suspended; false on timeout
+    bool await_resume() { return trigger->fired; }
+};
+
+inline void Trigger::fire() {
+    fired = true;
+    if (waiter != nullptr) {
+        CoroutineWaiter *resumed = waiter;
+        waiter = nullptr;
+        resumed->trigger = nullptr;
+        resumed->host->wake(resumed);
+    }
+}
+
+inline TriggerAwaiter Trigger::wait(omnetpp::simtime_t timeout) {
+    return TriggerAwaiter(this, timeout);
+}
+
+inline SleepAwaiter CoroutineModule::sleep(omnetpp::simtime_t delay) {
+    return SleepAwaiter(delay);
+}
+
+#endif // COROUTINEMODULE_H
@@ -0,0 +1,169 @@
+#ifndef DATASETSOURCE_H
+#define DATASETSOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Where the data array of each task comes from. The returned buffer stays
+// valid until the next call to nextTask(), so subtasks can view it in place.
+class DatasetSource {
+public:
+    virtual ~DatasetSource() {}
+
+    // Data for the given task (1-indexed), exactly length elements
+    virtual const int *nextTask(int taskId, size_t length) = 0;
+
+    virtual std::string describe() const = 0;
+};
+
+// One draw per element from a caller-supplied generator (the module RNG)
+class RandomDatasetSource : public DatasetSource {
+private:
+    std::function<int()> draw;
+    std::vector<int> buffer;
+
+public:
+    explicit RandomDatasetSource(std::function<int()> draw) : draw(draw) {}
+
+    const int *nextTask(int taskId, size_t length) override {
+        buffer.resize(length);
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = draw();
+        }
+        return buffer.data();
+    }
+
+    std::string describe() const override {
+        return "random";
+    }
+};
+
+// Fast deterministic generator (splitmix64) filling a reused buffer
+class StreamingDatasetSource : public DatasetSource {
+private:
+    uint64_t state;
+    int minValue;
+    int maxValue;
+    std::vector<int> buffer;
+
+    uint64_t nextRandom() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    StreamingDatasetSource(uint64_t seed, int minValue, int maxValue)
+        : state(seed), minValue(minValue), maxValue(maxValue) {}
+
+    const int *nextTask(int taskId, size_t length) override {
+        uint64_t range = (uint64_t)(maxValue - minValue) + 1;
+        buffer.resize(length);
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = minValue + (int)(nextRandom() % range);
+        }
+        return buffer.data();
+    }
+
+    std::string describe() const override {
+        return "stream";
+    }
+};
+
+// Read-only memory mapping of a raw file of native-endian 32-bit integers.
+// Task t uses the slice starting at firstOffset + (t - 1) * length.
+class MappedFileDatasetSource : public DatasetSource {
+private:
+    std::string path;
+    size_t firstOffset;
+    const int *data;
+    size_t elementCount;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    size_t mappedBytes;
+#endif
+
+public:
+    MappedFileDatasetSource(const std::string &path, size_t firstOffset)
+        : path(path), firstOffset(firstOffset), data(nullptr), elementCount(0) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open dataset file " + path);
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        elementCount = (size_t)size.QuadPart / sizeof(int);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            CloseHandle(file);
+            throw std::runtime_error("Cannot map dataset file " + path);
+        }
+        data = (const int *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open dataset file " + path);
+        }
+        struct stat info;
+        fstat(fd, &info);
+        mappedBytes = (size_t)info.st_size;
+        elementCount = mappedBytes / sizeof(int);
+        void *mapped = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Cannot map dataset file " + path);
+        }
+        // Tasks walk the file front to back
+        madvise(mapped, mappedBytes, MADV_SEQUENTIAL);
+        data = (const int *)mapped;
+#endif
+    }
+
+    ~MappedFileDatasetSource() {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        munmap((void *)data, mappedBytes);
+#endif
+    }
+
+    const int *nextTask(int taskId, size_t length) override {
+        size_t offset = firstOffset + (size_t)(taskId - 1) * length;
+        if (offset + length > elementCount) {
+            throw std::runtime_error("Dataset file " + path + " has " + std::to_string(elementCount) +
+                                     " elements, task " + std::to_string(taskId) + " needs up to element " +
+                                     std::to_string(offset + length));
+        }
+        return data + offset;
+    }
+
+    std::string describe() const override {
+        return "file " + path;
+    }
+};
+
+#endif // DATASETSOURCE_H
@@ -0,0 +1,289 @@
+#ifndef DECISIONLOG_H
+#define DECISIONLOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "DatasetSource.h"
+
+// Compact binary log of everything a client receives from outside: its RNG
+// seed, the data of each task, and every result, aggregate and gossip
+// message with its arrival time. Replaying the log drives the client's own
+// decisions (server selection, voting, scoring) without servers, aggregators
+// or the other clients.
+//
+// Layout: the magic "RXDL", then varint version, client id and seed, then
+// records of a type byte followed by varint fields. Signed values are
+// zigzag encoded and times are raw simtime deltas from the previous record.
+
+enum DecisionRecordType {
+    RECORD_TASK = 1,      // taskId, length, values
+    RECORD_RESULT = 2,    // time, taskId, subtaskId, serverId, result, stolenFrom + 1 (0 = not stolen)
+    RECORD_AGGREGATE = 3, // time, taskId, result, subtaskCount, majorities, scores
+    RECORD_GOSSIP = 4     // time, gate, taskNumber, timestamp bits, score
+};
+
+struct DecisionRecord {
+    int type;
+    int64_t time;       // raw simtime
+    int taskId;
+    int subtaskId;
+    int serverId;
+    int result;
+    int stolenFrom;     // server a stolen result was taken from, -1 if none
+    int subtaskCount;
+    int gate;
+    double timestamp;
+    std::string text;   // majorities or gossip score
+    std::string scores; // aggregate scores
+    std::vector<int> data;
+
+    DecisionRecord() : type(0), time(0), taskId(0), subtaskId(0), serverId(0), result(0), stolenFrom(-1),
+                       subtaskCount(0), gate(0), timestamp(0) {}
+};
+
+static const char DECISION_LOG_MAGIC[4] = {'R', 'X', 'D', 'L'};
+static const uint64_t DECISION_LOG_VERSION = 2;
+
+class DecisionLogWriter {
+private:
+    std::ofstream out;
+    int64_t lastTime;
+    uint64_t bytes;
+
+    void put(uint8_t byte) {
+        out.put((char)byte);
+        bytes++;
+    }
+
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            put((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        put((uint8_t)value);
+    }
+
+    void putSigned(int64_t value) {
+        putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    void putString(const std::string &str) {
+        putVarint(str.size());
+        out.write(str.data(), str.size());
+        bytes += str.size();
+    }
+
+    void putTime(int64_t time) {
+        putSigned(time - lastTime);
+        lastTime = time;
+    }
+
+public:
+    DecisionLogWriter(const std::string &path, int clientId, uint64_t seed)
+        : out(path, std::ios::binary | std::ios::trunc), lastTime(0), bytes(0) {
+        if (!out.is_open()) {
+            throw std::runtime_error("Cannot create decision log " + path);
+        }
+        out.write(DECISION_LOG_MAGIC, sizeof(DECISION_LOG_MAGIC));
+        bytes += sizeof(DECISION_LOG_MAGIC);
+        putVarint(DECISION_LOG_VERSION);
+        putVarint(clientId);
+        putVarint(seed);
+    }
+
+    void task(int taskId, const int *data, size_t length) {
+        put(RECORD_TASK);
+        putVarint(taskId);
+        putVarint(length);
+        for (size_t i = 0; i < length; i++) {
+            putSigned(data[i]);
+        }
+    }
+
+    void result(int64_t time, int taskId, int subtaskId, int serverId, int result, int stolenFrom) {
+        put(RECORD_RESULT);
+        putTime(time);
+        putVarint(taskId);
+        putVarint(subtaskId);
+        putVarint(serverId);
+        putSigned(result);
+        putVarint(stolenFrom + 1);
+    }
+
+    void aggregate(int64_t time, int taskId, int result, int subtaskCount,
+                   const std::string &majorities, const std::string &scores) {
+        put(RECORD_AGGREGATE);
+        putTime(time);
+        putVarint(taskId);
+        putSigned(result);
+        putVarint(subtaskCount);
+        putString(majorities);
+        putString(scores);
+    }
+
+    void gossip(int64_t time, int gate, int taskNumber, double timestamp, const std::string &score) {
+        uint64_t bits;
+        std::memcpy(&bits, &timestamp, sizeof(bits));
+
+        put(RECORD_GOSSIP);
+        putTime(time);
+        putVarint(gate);
+        putVarint(taskNumber);
+        putVarint(bits);
+        putString(score);
+    }
+
+    void flush() { out.flush(); }
+    uint64_t getBytes() const { return bytes; }
+};
+
+class DecisionLogReader {
+private:
+    std::vector<uint8_t> buffer;
+    size_t pos;
+    int64_t lastTime;
+    std::string path;
+
+    uint8_t get() {
+        if (pos >= buffer.size()) {
+            throw std::runtime_error("Decision log " + path + " is truncated");
+        }
+        return buffer[pos++];
+    }
+
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = get();
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Decision log " + path + " has a malformed number");
+    }
+
+    int64_t getSigned() {
+        uint64_t value = getVarint();
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    std::string getString() {
+        size_t length = getVarint();
+        if (pos + length > buffer.size()) {
+            throw std::runtime_error("Decision log " + path + " is truncated");
+        }
+        std::string str((const char *)buffer.data() + pos, length);
+        pos += length;
+        return str;
+    }
+
+    int64_t getTime() {
+        lastTime += getSigned();
+        return lastTime;
+    }
+
+public:
+    int clientId;
+    uint64_t seed;
+
+    explicit DecisionLogReader(const std::string &path) : pos(0), lastTime(0), path(path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            throw std::runtime_error("Cannot open decision log " + path);
+        }
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+        if (buffer.size() < sizeof(DECISION_LOG_MAGIC) ||
+            std::memcmp(buffer.data(), DECISION_LOG_MAGIC, sizeof(DECISION_LOG_MAGIC)) != 0) {
+            throw std::runtime_error(path + " is not a decision log");
+        }
+        pos = sizeof(DECISION_LOG_MAGIC);
+        if (getVarint() != DECISION_LOG_VERSION) {
+            throw std::runtime_error("Decision log " + path + " has an unsupported version");
+        }
+        clientId = (int)getVarint();
+        seed = getVarint();
+    }
+
+    // Next record, false at the end of the log
+    bool next(DecisionRecord &record) {
+        if (pos >= buffer.size()) {
+            return false;
+        }
+        record = DecisionRecord();
+        record.type = get();
+        switch (record.type) {
+        case RECORD_TASK: {
+            record.taskId = (int)getVarint();
+            size_t length = getVarint();
+            record.data.resize(length);
+            for (size_t i = 0; i < length; i++) {
+                record.data[i] = (int)getSigned();
+            }
+            break;
+        }
+        case RECORD_RESULT:
+            record.time = getTime();
+            record.taskId = (int)getVarint();
+            record.subtaskId = (int)getVarint();
+            record.serverId = (int)getVarint();
+            record.result = (int)getSigned();
+            record.stolenFrom = (int)getVarint() - 1;
+            break;
+        case RECORD_AGGREGATE:
+            record.time = getTime();
+            record.taskId = (int)getVarint();
+            record.result = (int)getSigned();
+            record.subtaskCount = (int)getVarint();
+            record.text = getString();
+            record.scores = getString();
+            break;
+        case RECORD_GOSSIP: {
+            record.time = getTime();
+            record.gate = (int)getVarint();
+            record.taskId = (int)getVarint();
+            uint64_t bits = getVarint();
+            std::memcpy(&record.timestamp, &bits, sizeof(bits));
+            record.text = getString();
+            break;
+        }
+        default:
+            throw std::runtime_error("Decision log " + path + " has an unknown record type");
+        }
+        return true;
+    }
+};
+
+// Task data taken from the RECORD_TASK records of a decision log
+class ReplayDatasetSource : public DatasetSource {
+private:
+    std::vector<std::vector<int>> tasks; // index taskId - 1
+
+public:
+    void addTask(int taskId, const std::vector<int> &data) {
+        if ((int)tasks.size() < taskId) {
+            tasks.resize(taskId);
+        }
+        tasks[taskId - 1] = data;
+    }
+
+    const int *nextTask(int taskId, size_t length) override {
+        if (taskId < 1 || taskId > (int)tasks.size() || tasks[taskId - 1].size() != length) {
+            throw std::runtime_error("Decision log has no data of length " + std::to_string(length) +
+                                     " for task " + std::to_string(taskId));
+        }
+        return tasks[taskId - 1].data();
+    }
+
+    std::string describe() const override {
+        return "replay";
+    }
+};
+
+#endif // DECISIONLOG_H
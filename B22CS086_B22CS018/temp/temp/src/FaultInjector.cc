@@ -0,0 +1,312 @@
+#include <omnetpp.h>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include "Logging.h"
+
+using namespace omnetpp;
+using namespace std;
+
+const string INJECTOR_OUTPUT = "output.txt";
+
+// Replays a timeline of faults read from a script file. Each non-empty line is
+//   <time> <action> <arguments...>
+// with '#' starting a comment:
+//   crash <servers>                       stop serving, losing queued work
+//   restart <servers>                     serve again, with an empty queue
+//   slowdown <servers> <factor>           multiply the service time (1 = normal)
+//   drop <from> <to> <probability>        packet loss rate of a link
+//   delay <from> <to> <seconds>           propagation delay of a link
+//   correlated <servers> <count> <for>    crash count of the servers at once,
+//                                         restarting them <for> seconds later
+//                                         (0 = never)
+// <servers> is "*" or a list such as "0,2-3"; link ends are client[i] or
+// server[j]. Random choices use the module RNG and link losses the channel
+// RNG, so every run is reproducible from the seed.
+class FaultInjector : public cSimpleModule
+{
+private:
+    struct FaultEvent {
+        simtime_t time;
+        string action;
+        vector<int> servers;
+        cModule *from;      // link faults: sending end
+        int toIndex;        // link faults: gate index of the receiving end
+        double value;       // slowdown factor, loss probability or delay
+        int count;          // correlated: servers to crash
+        double duration;    // correlated: time until they restart
+        int line;
+
+        FaultEvent() : from(nullptr), toIndex(-1), value(0), count(0), duration(0), line(0) {}
+    };
+
+    vector<FaultEvent> events;
+    vector<cMessage*> timers;
+    int faultsInjected;
+
+public:
+    ~FaultInjector() {
+        for (cMessage *timer : timers) {
+            cancelAndDelete(timer);
+        }
+    }
+
+protected:
+    void initialize() override {
+        faultsInjected = 0;
+
+        string script = par("faultScript").stdstringValue();
+        if (script.empty()) {
+            return;
+        }
+
+        ifstream in(script);
+        if (!in.is_open()) {
+            throw cRuntimeError("Cannot open fault script %s", script.c_str());
+        }
+
+        string line;
+        int lineNumber = 0;
+        while (getline(in, line)) {
+            lineNumber++;
+            size_t commentPos = line.find('#');
+            if (commentPos != string::npos) {
+                line = line.substr(0, commentPos);
+            }
+            istringstream ss(line);
+            vector<string> words;
+            string word;
+            while (ss >> word) {
+                words.push_back(word);
+            }
+            if (words.empty()) {
+                continue;
+            }
+            events.push_back(parseEvent(words, lineNumber));
+        }
+
+        for (int i = 0; i < (int)events.size(); i++) {
+            schedule(i);
+        }
+    }
+
+    void handleMessage(cMessage *msg) override {
+        // Copied, since a correlated crash may append its restart to events
+        FaultEvent event = events[msg->par("event").longValue()];
+        apply(event);
+    }
+
+    void finish() override {
+        recordScalar("faultsInjected", faultsInjected);
+    }
+
+    FaultEvent parseEvent(const vector<string> &words, int lineNumber) {
+        FaultEvent event;
+        event.line = lineNumber;
+        if (words.size() < 3) {
+            throw cRuntimeError("Fault script line %d: expected <time> <action> <arguments>", lineNumber);
+        }
+        event.time = parseNumber(words[0], lineNumber);
+        event.action = words[1];
+
+        if (event.action == "crash" || event.action == "restart") {
+            expectArguments(words, 1, lineNumber);
+            event.servers = parseServers(words[2], lineNumber);
+        } else if (event.action == "slowdown") {
+            expectArguments(words, 2, lineNumber);
+            event.servers = parseServers(words[2], lineNumber);
+            event.value = parseNumber(words[3], lineNumber);
+            if (event.value <= 0) {
+                throw cRuntimeError("Fault script line %d: slowdown factor must be positive", lineNumber);
+            }
+        } else if (event.action == "drop" || event.action == "delay") {
+            expectArguments(words, 3, lineNumber);
+            int fromIndex, toIndex;
+            string fromType = parseEndpoint(words[2], fromIndex, lineNumber);
+            string toType = parseEndpoint(words[3], toIndex, lineNumber);
+            if (fromType == toType) {
+                throw cRuntimeError("Fault script line %d: links connect a client and a server", lineNumber);
+            }
+            event.from = getParentModule()->getSubmodule(fromType.c_str(), fromIndex);
+            if (event.from == nullptr) {
+                throw cRuntimeError("Fault script line %d: no module %s", lineNumber, words[2].c_str());
+            }
+            event.toIndex = toIndex;
+            event.value = parseNumber(words[4], lineNumber);
+            if (event.action == "drop" && (event.value < 0 || event.value > 1)) {
+                throw cRuntimeError("Fault script line %d: drop probability must be in [0, 1]", lineNumber);
+            }
+        } else if (event.action == "correlated") {
+            expectArguments(words, 3, lineNumber);
+            event.servers = parseServers(words[2], lineNumber);
+            event.count = (int)parseNumber(words[3], lineNumber);
+            event.duration = parseNumber(words[4], lineNumber);
+            if (event.count < 1 || event.count > (int)event.servers.size()) {
+                throw cRuntimeError("Fault script line %d: cannot crash %d of %d servers", lineNumber,
+                                    event.count, (int)event.servers.size());
+            }
+        } else {
+            throw cRuntimeError("Fault script line %d: unknown action '%s'", lineNumber, event.action.c_str());
+        }
+        return event;
+    }
+
+    void expectArguments(const vector<string> &words, int count, int lineNumber) {
+        if ((int)words.size() != count + 2) {
+            throw cRuntimeError("Fault script line %d: '%s' takes %d arguments", lineNumber, words[1].c_str(), count);
+        }
+    }
+
+    double parseNumber(const string &word, int lineNumber) {
+        try {
+            size_t used;
+            double value = stod(word, &used);
+            if (used == word.size()) {
+                return value;
+            }
+        } catch (const exception &) {
+        }
+        throw cRuntimeError("Fault script line %d: '%s' is not a number", lineNumber, word.c_str());
+    }
+
+    // "*" or a comma separated list of server ids and ranges (e.g. 0,2-3)
+    vector<int> parseServers(const string &word, int lineNumber) {
+        int numServers = getParentModule()->par("numServers");
+        vector<int> servers;
+        if (word == "*") {
+            for (int i = 0; i < numServers; i++) {
+                servers.push_back(i);
+            }
+            return servers;
+        }
+
+        istringstream ss(word);
+        string token;
+        while (getline(ss, token, ',')) {
+            size_t dashPos = token.find('-');
+            int first = (int)parseNumber(token.substr(0, dashPos), lineNumber);
+            int last = (dashPos == string::npos) ? first : (int)parseNumber(token.substr(dashPos + 1), lineNumber);
+            if (first < 0 || last >= numServers || first > last) {
+                throw cRuntimeError("Fault script line %d: bad server range '%s'", lineNumber, token.c_str());
+            }
+            for (int i = first; i <= last; i++) {
+                if (find(servers.begin(), servers.end(), i) == servers.end()) {
+                    servers.push_back(i);
+                }
+            }
+        }
+        return servers;
+    }
+
+    // client[i] or server[j]; returns the module name and sets index
+    string parseEndpoint(const string &word, int &index, int lineNumber) {
+        size_t openPos = word.find('[');
+        if (openPos == string::npos || word.back() != ']') {
+            throw cRuntimeError("Fault script line %d: expected client[i] or server[j], got '%s'", lineNumber, word.c_str());
+        }
+        string type = word.substr(0, openPos);
+        if (type != "client" && type != "server") {
+            throw cRuntimeError("Fault script line %d: expected client[i] or server[j], got '%s'", lineNumber, word.c_str());
+        }
+        index = (int)parseNumber(word.substr(openPos + 1, word.size() - openPos - 2), lineNumber);
+        return type;
+    }
+
+    void schedule(int eventIndex) {
+        cMessage *timer = new cMessage("FaultEvent");
+        timer->addPar("event");
+        timer->par("event") = eventIndex;
+        timers.push_back(timer);
+        scheduleAt(max(simTime(), events[eventIndex].time), timer);
+    }
+
+    void apply(const FaultEvent &event) {
+        faultsInjected++;
+
+        if (event.action == "crash" || event.action == "restart") {
+            for (int serverId : event.servers) {
+                sendFault(serverId, event.action, 0);
+            }
+            LOG_INFO("FaultInjector: " + event.action + " servers " + formatServers(event.servers));
+        } else if (event.action == "slowdown") {
+            for (int serverId : event.servers) {
+                sendFault(serverId, "slowdown", event.value);
+            }
+            LOG_INFO("FaultInjector: slowdown x" + to_string(event.value) + " on servers " + formatServers(event.servers));
+        } else if (event.action == "drop" || event.action == "delay") {
+            cChannel *channel = event.from->gate("out", event.toIndex)->getChannel();
+            if (channel == nullptr) {
+                throw cRuntimeError("Fault script line %d: the link has no channel", event.line);
+            }
+            if (event.action == "drop") {
+                channel->par("per").setDoubleValue(event.value);
+            } else {
+                channel->par("delay").setDoubleValue(event.value);
+            }
+            LOG_INFO("FaultInjector: " + event.action + " " + to_string(event.value) + " on link " +
+                     event.from->getFullName() + " out[" + to_string(event.toIndex) + "]");
+        } else if (event.action == "correlated") {
+            // Pick the victims with the module RNG so the choice follows the seed
+            vector<int> candidates = event.servers;
+            vector<int> victims;
+            for (int i = 0; i < event.count; i++) {
+                int pick = intuniform(0, (int)candidates.size() - 1);
+                victims.push_back(candidates[pick]);
+                candidates.erase(candidates.begin() + pick);
+            }
+            sort(victims.begin(), victims.end());
+
+            for (int serverId : victims) {
+                sendFault(serverId, "crash", 0);
+            }
+            LOG_INFO("FaultInjector: correlated crash of servers " + formatServers(victims));
+
+            if (event.duration > 0) {
+                FaultEvent restart;
+                restart.time = simTime() + event.duration;
+                restart.action = "restart";
+                restart.servers = victims;
+                restart.line = event.line;
+                events.push_back(restart);
+                schedule(events.size() - 1);
+            }
+        }
+    }
+
+    void sendFault(int serverId, const string &fault, double factor) {
+        cMessage *fm = new cMessage("FaultMessage");
+
+        fm->addPar("fault");
+        fm->par("fault") = fault.c_str();
+
+        fm->addPar("factor");
+        fm->par("factor") = factor;
+
+        sendDirect(fm, getParentModule()->getSubmodule("server", serverId), "faultIn");
+    }
+
+    static string formatServers(const vector<int> &servers) {
+        string str;
+        for (int serverId : servers) {
+            if (!str.empty()) {
+                str += ",";
+            }
+            str += to_string(serverId);
+        }
+        return str;
+    }
+
+    void logToFile(const string &line) {
+        ofstream out(INJECTOR_OUTPUT, ios::app);
+        if (!out.is_open()) {
+            cout << "Error opening file " << INJECTOR_OUTPUT << "\n";
+            return;
+        }
+        out << line << "\n";
+        out.close();
+    }
+};
+
+Define_Module(FaultInjector);
@@ -0,0 +1,83 @@
+#ifndef KERNELEXECUTOR_H
+#define KERNELEXECUTOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Host thread pool that runs server kernels on real cores, for calibrating
+// the simulated service times against measured ones. The simulation itself
+// stays single-threaded: the calling module blocks in parallelFor until all
+// jobs are done, so kernels only touch data owned by that call.
+class KernelExecutor {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable workDone;
+
+    // The parallelFor in progress: jobs [next, count) are unclaimed
+    const std::function<void(size_t)> *job;
+    size_t next;
+    size_t count;
+    size_t finished;
+
+    explicit KernelExecutor(int threads) : job(nullptr), next(0), count(0), finished(0) {
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            workReady.wait(lock, [this]() { return job != nullptr && next < count; });
+            size_t index = next++;
+            const std::function<void(size_t)> &fn = *job;
+
+            lock.unlock();
+            fn(index);
+            lock.lock();
+
+            if (++finished == count) {
+                workDone.notify_one();
+            }
+        }
+    }
+
+public:
+    // Created on first use with the given number of threads (0 = one per
+    // core); later calls share it. Never destroyed, like the other singletons.
+    static KernelExecutor *getShared(int threads) {
+        static KernelExecutor *instance = nullptr;
+        if (instance == nullptr) {
+            if (threads <= 0) {
+                threads = (int)std::thread::hardware_concurrency();
+            }
+            instance = new KernelExecutor(threads > 0 ? threads : 1);
+        }
+        return instance;
+    }
+
+    int getThreads() const { return (int)workers.size(); }
+
+    // Run fn(0) .. fn(n - 1) on the pool and return once all have finished
+    void parallelFor(size_t n, const std::function<void(size_t)> &fn) {
+        if (n == 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &fn;
+        next = 0;
+        count = n;
+        finished = 0;
+        workReady.notify_all();
+        workDone.wait(lock, [this]() { return finished == count; });
+        job = nullptr;
+    }
+};
+
+#endif // KERNELEXECUTOR_H
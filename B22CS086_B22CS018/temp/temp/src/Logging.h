@@ -0,0 +1,35 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+// Leveled log lines. Levels above REMOTEEXEC_LOG_LEVEL compile to nothing,
+// including the string building in their arguments; build with
+// `make LOG_LEVEL=info` or `make HEADLESS=1` (see makefrag).
+//
+//   LOG_INFO("Client " + to_string(getIndex()) + " starting task ...");
+//   if (LOG_ENABLED(DEBUG)) { ...multi-statement dump...; logToFile(ss.str()); }
+//
+// The macros call the module's own logToFile(const string &).
+
+#define REMOTEEXEC_LOG_OFF 0
+#define REMOTEEXEC_LOG_INFO 1  // task lifecycle, results and injected faults
+#define REMOTEEXEC_LOG_DEBUG 2 // every message, vote and per-server table
+
+#ifndef REMOTEEXEC_LOG_LEVEL
+#define REMOTEEXEC_LOG_LEVEL REMOTEEXEC_LOG_DEBUG
+#endif
+
+#define LOG_ENABLED(level) (REMOTEEXEC_LOG_##level <= REMOTEEXEC_LOG_LEVEL)
+
+#if LOG_ENABLED(INFO)
+#define LOG_INFO(message) logToFile(message)
+#else
+#define LOG_INFO(message) do {} while (0)
+#endif
+
+#if LOG_ENABLED(DEBUG)
+#define LOG_DEBUG(message) logToFile(message)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#endif
+
+#endif // LOGGING_H
@@ -0,0 +1,146 @@
+#ifndef MAPREDUCE_H
+#define MAPREDUCE_H
+
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "VoteTracker.h"
+
+// Word count over the task array as a two-stage job. Every map subtask counts
+// the values of its slice and splits the counts into hash partitions; each
+// partition is shuffled to all reduce servers of that partition. A reducer
+// takes, for every map subtask, the partition the majority of its replicas
+// produced, sums them and reports the counts to the client, which votes on
+// the replies of the partition's reduce replicas.
+//
+// Counts travel as "key count key count ..." so that servers parse and time
+// them like any other payload; results sent to the client are "key=count,...".
+namespace MapReduce {
+
+    inline int partitionOf(int key, int partitions) {
+        return (int)(((uint32_t)key * 2654435761u) % (uint32_t)partitions);
+    }
+
+    // Counts as a payload, keys in ascending order
+    inline std::string encodeCounts(const std::map<int, long> &counts) {
+        std::stringstream ss;
+        for (const auto &entry : counts) {
+            ss << entry.first << " " << entry.second << " ";
+        }
+        return ss.str();
+    }
+
+    inline std::string formatCounts(const std::map<int, long> &counts) {
+        std::string text;
+        for (const auto &entry : counts) {
+            text += (text.empty() ? "" : ",") + std::to_string(entry.first) + "=" + std::to_string(entry.second);
+        }
+        return text;
+    }
+
+    // Adds "key=count,..." to counts
+    inline void addFormattedCounts(const std::string &text, std::map<int, long> &counts) {
+        std::istringstream entries(text);
+        std::string token;
+        while (std::getline(entries, token, ',')) {
+            size_t equalsPos = token.find('=');
+            if (equalsPos == std::string::npos) continue;
+
+            counts[std::stoi(token.substr(0, equalsPos))] += std::stol(token.substr(equalsPos + 1));
+        }
+    }
+
+    // Replicas vote on the index of their output among the distinct outputs
+    // received so far, so only identical payloads count as agreement. There
+    // are at most a few distinct outputs per vote, and a differing length
+    // rejects most of them without comparing characters.
+    inline int payloadIndex(std::vector<std::string> &payloads, const std::string &payload, bool &added) {
+        for (size_t i = 0; i < payloads.size(); i++) {
+            if (payloads[i] == payload) {
+                added = false;
+                return (int)i;
+            }
+        }
+        payloads.push_back(payload);
+        added = true;
+        return (int)payloads.size() - 1;
+    }
+
+    // The shuffle inputs of one reduce partition: a streaming majority vote
+    // per map subtask over the partitions its replicas sent
+    class ShuffleCollector {
+    private:
+        struct MapInput {
+            VoteTracker vote;
+            std::vector<std::string> candidates; // distinct payloads, voted on by index
+        };
+
+        std::vector<MapInput> inputs;
+        int decided;
+        long bytes;
+        std::string mapScores; // serverId=1 (agreed) or 0, for every replica counted before a decision
+
+    public:
+        ShuffleCollector() : decided(0), bytes(0) {}
+
+        // Count one map replica's partition; true once every map subtask is decided
+        bool add(int mapSubtasks, int mapSubtask, int replicas, int serverId, const std::string &payload) {
+            if (inputs.empty()) {
+                inputs.resize(mapSubtasks);
+            }
+            MapInput &input = inputs.at(mapSubtask);
+            if (input.vote.getExpected() == 0) {
+                input.vote.reset(replicas);
+            }
+            if (input.vote.isDecided()) {
+                return false; // Late replica
+            }
+
+            bool added;
+            int candidate = payloadIndex(input.candidates, payload, added);
+            if (added) {
+                bytes += payload.size();
+            }
+            if (!input.vote.add(serverId, candidate)) {
+                return false;
+            }
+
+            input.vote.forEachPendingReply([&](int mapServer, bool agreed) {
+                mapScores += (mapScores.empty() ? "" : ",") + std::to_string(mapServer) + "=" + (agreed ? "1" : "0");
+            });
+            input.vote.clearPending();
+
+            // Only the majority payload is kept for the reduce
+            for (const std::string &candidate : input.candidates) {
+                bytes -= candidate.size();
+            }
+            std::string majority = std::move(input.candidates[input.vote.getMajority()]);
+            input.candidates.assign(1, std::move(majority));
+            bytes += input.candidates.front().size();
+
+            return ++decided == (int)inputs.size();
+        }
+
+        bool isComplete() const { return !inputs.empty() && decided == (int)inputs.size(); }
+
+        // The majority partitions of all map subtasks, back to back
+        std::string reduceInput() const {
+            std::string input;
+            for (const MapInput &mapInput : inputs) {
+                input += mapInput.candidates.front();
+            }
+            return input;
+        }
+
+        const std::string &getMapScores() const { return mapScores; }
+
+        long memoryBytes() const {
+            return sizeof(ShuffleCollector) + inputs.capacity() * sizeof(MapInput) + bytes;
+        }
+    };
+}
+
+#endif // MAPREDUCE_H
@@ -17,11 +17,18 @@ private:
     // Total number of servers in the system
     int totalServers;
 
+    // Estimated bytes held by maliciousServers
+    size_t stateBytes;
+
     // Random number generator
     std::mt19937 rng;
 
+    // Draw each task's malicious set from (sharedSeed, clientId, taskId) instead of rng
+    bool keyed;
+    unsigned sharedSeed;
+
     // Private constructor for singleton
-    MasterServer() : totalServers(0) {
+    MasterServer() : totalServers(0), stateBytes(0), keyed(false), sharedSeed(0) {
         // Seed the random number generator
         std::random_device rd;
         rng.seed(rd());
@@ -41,6 +48,13 @@ public:
         totalServers = count;
     }
 
+    // Separate processes that each hold a MasterServer (the emulation servers)
+    // agree on which servers sabotage a task when they share a seed
+    void setSharedSeed(unsigned seed) {
+        keyed = true;
+        sharedSeed = seed;
+    }
+
     // Determine which servers are malicious for a given client task
     void determineServerBehavior(int clientId, int taskId) {
         std::pair<int, int> key = std::make_pair(clientId, taskId);
@@ -50,12 +64,19 @@ public:
             return;
         }
 
+        std::mt19937 keyedRng;
+        if (keyed) {
+            std::seed_seq seq{sharedSeed, (unsigned)clientId, (unsigned)taskId};
+            keyedRng.seed(seq);
+        }
+        std::mt19937 &draw = keyed ? keyedRng : rng;
+
         // Maximum malicious servers allowed: strictly less than n/4
         int maxMalicious = totalServers / 4;
 
         // Select a random number of servers to be malicious (0 to maxMalicious-1)
         std::uniform_int_distribution<> numDist(0,maxMalicious - 1);
-        int numMalicious = numDist(rng);
+        int numMalicious = numDist(draw);
 
         // Create a vector of all server IDs
         std::vector<int> allServers;
@@ -64,7 +85,7 @@ public:
         }
 
         // Shuffle the servers
-        std::shuffle(allServers.begin(), allServers.end(), rng);
+        std::shuffle(allServers.begin(), allServers.end(), draw);
 
         // Select the first numMalicious servers to be malicious
         std::set<int> malicious;
@@ -74,6 +95,9 @@ public:
 
         // Store the malicious servers for this client task
         maliciousServers[key] = malicious;
+
+        // One map node plus one set node per malicious server (~32 bytes of links each)
+        stateBytes += sizeof(key) + sizeof(malicious) + 32 + malicious.size() * (sizeof(int) + 32);
     }
 
     // Check if a specific server is malicious for a given client task
@@ -89,6 +113,10 @@ public:
         return maliciousServers[key].find(serverId) != maliciousServers[key].end();
     }
 
+    size_t getStateBytes() const {
+        return stateBytes;
+    }
+
     // For debugging: get the total count of malicious servers for a client task
     int getMaliciousCount(int clientId, int taskId) {
         std::pair<int, int> key = std::make_pair(clientId, taskId);
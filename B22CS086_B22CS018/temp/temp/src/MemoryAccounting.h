@@ -0,0 +1,77 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+// Byte counters for the major model structures and in-flight payloads, kept
+// up to date by the model itself as the structures change. Counters are
+// shared by all modules of a kind (e.g. "client.reputation" covers every
+// client) and remember their peak. Sizes are estimates: element sizes plus
+// a typical per-node overhead for the standard containers.
+class MemoryAccounting {
+public:
+    // Per-element bookkeeping of node-based containers (pointers, color, hash)
+    static const size_t TREE_NODE_OVERHEAD = 32;
+    static const size_t HASH_NODE_OVERHEAD = 24;
+
+    struct Account {
+        long current;
+        long peak;
+
+        Account() : current(0), peak(0) {}
+
+        void add(long bytes) {
+            current += bytes;
+            if (current > peak) {
+                peak = current;
+            }
+        }
+
+        // For structures that are cheaper to re-measure than to track
+        void replace(long previousBytes, long bytes) {
+            add(bytes - previousBytes);
+        }
+    };
+
+private:
+    // std::map keeps the account addresses stable
+    std::map<std::string, Account> accounts;
+    int modules;
+
+    MemoryAccounting() : modules(0) {}
+
+public:
+    static MemoryAccounting *getShared() {
+        static MemoryAccounting *instance = new MemoryAccounting();
+        return instance;
+    }
+
+    // Modules attach in their constructor; the first one of a run starts
+    // every account from zero again
+    void attach() {
+        if (modules++ == 0) {
+            for (auto &entry : accounts) {
+                entry.second = Account();
+            }
+        }
+    }
+
+    void detach() {
+        modules--;
+    }
+
+    Account *account(const std::string &name) {
+        return &accounts[name];
+    }
+
+    const std::map<std::string, Account> &getAccounts() const { return accounts; }
+
+    // A string object and its characters
+    static size_t stringBytes(const std::string &str) {
+        return sizeof(std::string) + str.size() + 1;
+    }
+};
+
+#endif // MEMORYACCOUNTING_H
@@ -0,0 +1,133 @@
+#ifndef MESSAGEPOOL_H
+#define MESSAGEPOOL_H
+
+#include <omnetpp.h>
+#include <vector>
+
+// Per-module recycling pool for the protocol messages (tasks, results,
+// aggregates and gossip). A module hands the messages it received back with
+// release() instead of deleting them, and acquire() reuses one of them for the
+// next message it sends. The parameters of a released message are detached and
+// kept as well, so addPar() can reuse them instead of allocating new ones.
+//
+// Every pooled message is a cPacket. Messages other than TaskMessage keep a
+// length of 0, so they take no transmission time on the links, as before.
+class MessagePool {
+private:
+    std::vector<omnetpp::cPacket *> freePackets;
+    std::vector<omnetpp::cMsgPar *> freePars;
+    size_t capacity; // messages kept; parameters are capped at 8 per message
+
+    long acquired;
+    long messageHits;
+    long parsAllocated;
+    long parsReused;
+
+public:
+    MessagePool() : capacity(0), acquired(0), messageHits(0), parsAllocated(0), parsReused(0) {}
+
+    ~MessagePool() {
+        for (omnetpp::cPacket *pkt : freePackets) {
+            delete pkt;
+        }
+        for (omnetpp::cMsgPar *par : freePars) {
+            delete par;
+        }
+    }
+
+    // 0 disables pooling: acquire() always allocates and release() deletes
+    void setCapacity(size_t maxMessages) {
+        capacity = maxMessages;
+    }
+
+    // A clean message: no parameters, kind 0, length 0
+    omnetpp::cPacket *acquire(const char *name) {
+        acquired++;
+        if (freePackets.empty()) {
+            return new omnetpp::cPacket(name);
+        }
+
+        messageHits++;
+        omnetpp::cPacket *pkt = freePackets.back();
+        freePackets.pop_back();
+        pkt->setName(name);
+        pkt->setKind(0);
+        pkt->setByteLength(0);
+        pkt->setBitError(false);
+        pkt->setTimestamp(SIMTIME_ZERO);
+        return pkt;
+    }
+
+    // Add a parameter to a message, reusing a detached one if possible
+    omnetpp::cMsgPar &addPar(omnetpp::cMessage *msg, const char *name) {
+        if (freePars.empty()) {
+            parsAllocated++;
+            return msg->addPar(name);
+        }
+
+        parsReused++;
+        omnetpp::cMsgPar *par = freePars.back();
+        freePars.pop_back();
+        par->setName(name);
+        msg->getParList().add(par);
+        return *par;
+    }
+
+    // Detach one parameter and keep it like those of a released message
+    void removePar(omnetpp::cMessage *msg, const char *name) {
+        omnetpp::cArray &pars = msg->getParList();
+        int i = pars.find(name);
+        if (i < 0) {
+            return;
+        }
+        omnetpp::cMsgPar *par = static_cast<omnetpp::cMsgPar *>(pars.remove(i));
+        if (freePars.size() < capacity * 8) {
+            freePars.push_back(par);
+        } else {
+            delete par;
+        }
+    }
+
+    // Same name and parameters as msg, replacing dup()
+    omnetpp::cPacket *copy(omnetpp::cMessage *msg) {
+        omnetpp::cPacket *pkt = acquire(msg->getName());
+        omnetpp::cArray &pars = msg->getParList();
+        for (int i = 0; i < pars.size(); i++) {
+            omnetpp::cMsgPar *par = static_cast<omnetpp::cMsgPar *>(pars.get(i));
+            if (par != nullptr) {
+                addPar(pkt, par->getName()) = *par;
+            }
+        }
+        return pkt;
+    }
+
+    // Take back a message the module owns; it must not be scheduled or sent
+    void release(omnetpp::cMessage *msg) {
+        omnetpp::cArray &pars = msg->getParList();
+        for (int i = 0; i < pars.size(); i++) {
+            omnetpp::cObject *par = pars.get(i);
+            if (par == nullptr) {
+                continue;
+            }
+            if (freePars.size() < capacity * 8) {
+                freePars.push_back(static_cast<omnetpp::cMsgPar *>(pars.remove(i)));
+            }
+        }
+        pars.clear();
+
+        omnetpp::cPacket *pkt = dynamic_cast<omnetpp::cPacket *>(msg);
+        if (pkt != nullptr && freePackets.size() < capacity) {
+            freePackets.push_back(pkt);
+        } else {
+            delete msg;
+        }
+    }
+
+    long getAcquired() const { return acquired; }
+    long getMessagesAllocated() const { return acquired - messageHits; }
+    long getParsAllocated() const { return parsAllocated; }
+    long getParsReused() const { return parsReused; }
+    double getHitRate() const { return acquired > 0 ? (double)messageHits / acquired : 0.0; }
+};
+
+#endif // MESSAGEPOOL_H
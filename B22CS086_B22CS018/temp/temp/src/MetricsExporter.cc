@@ -0,0 +1,204 @@
+#include <omnetpp.h>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include "MetricsRegistry.h"
+#include "MemoryAccounting.h"
+
+using namespace omnetpp;
+using namespace std;
+
+// Periodically writes a snapshot of the run to metricsFile while it is in
+// progress: event rate, simulated/real time ratio, the shared counters and
+// every registered gauge (outstanding subtasks per client, server queue
+// depths, reputation spread) and the current bytes of every memory account.
+// The file rotates to <metricsFile>.1 after maxSnapshots rows, so a long sweep
+// can be followed with tail -f. At finish the memory peaks are also written
+// to memoryReport, largest first.
+class MetricsExporter : public cSimpleModule
+{
+private:
+    simtime_t interval;
+    string metricsFile;
+    bool json;
+    int maxSnapshots;
+
+    ofstream out;
+    int snapshotsInFile;
+    int snapshotsWritten;
+    cMessage *sampleTimer;
+
+    // State at the previous snapshot, for the rates
+    chrono::steady_clock::time_point lastWallTime;
+    int64_t lastEventNumber;
+    simtime_t lastSimTime;
+    double wallSeconds;
+
+public:
+    MetricsExporter() : sampleTimer(nullptr) {}
+
+    ~MetricsExporter() {
+        cancelAndDelete(sampleTimer);
+    }
+
+protected:
+    void initialize() override {
+        interval = par("interval").doubleValue();
+        metricsFile = par("metricsFile").stdstringValue();
+        maxSnapshots = par("maxSnapshots");
+        string format = par("metricsFormat").stdstringValue();
+        if (format != "csv" && format != "json") {
+            throw cRuntimeError("Unknown metricsFormat '%s' (expected csv or json)", format.c_str());
+        }
+        json = (format == "json");
+        snapshotsWritten = 0;
+
+        if (interval <= SIMTIME_ZERO) {
+            return; // Exporter disabled
+        }
+
+        openFile();
+        lastWallTime = chrono::steady_clock::now();
+        lastEventNumber = getSimulation()->getEventNumber();
+        lastSimTime = simTime();
+        wallSeconds = 0;
+
+        sampleTimer = new cMessage("MetricsSample");
+        scheduleAt(simTime() + interval, sampleTimer);
+    }
+
+    void handleMessage(cMessage *msg) override {
+        writeSnapshot();
+
+        // Stop once nothing else is scheduled, or the run would never end
+        if (!getSimulation()->getFES()->isEmpty()) {
+            scheduleAt(simTime() + interval, sampleTimer);
+        }
+    }
+
+    void finish() override {
+        if (out.is_open()) {
+            writeSnapshot();
+            out.close();
+        }
+        recordScalar("metricsSnapshots", snapshotsWritten);
+        writeMemoryReport();
+    }
+
+    void writeMemoryReport() {
+        vector<pair<string, MemoryAccounting::Account>> accounts(MemoryAccounting::getShared()->getAccounts().begin(),
+                                                                 MemoryAccounting::getShared()->getAccounts().end());
+        sort(accounts.begin(), accounts.end(), [](const pair<string, MemoryAccounting::Account> &a,
+                                                  const pair<string, MemoryAccounting::Account> &b) {
+            return a.second.peak > b.second.peak;
+        });
+
+        long peakSum = 0;
+        for (auto &account : accounts) {
+            recordScalar(("memory." + account.first + ".peakBytes").c_str(), account.second.peak);
+            peakSum += account.second.peak;
+        }
+
+        string reportFile = par("memoryReport").stdstringValue();
+        if (reportFile.empty()) {
+            return;
+        }
+        ofstream report(reportFile, ios::trunc);
+        if (!report.is_open()) {
+            cout << "Error opening file " << reportFile << "\n";
+            return;
+        }
+        report << "# Estimated bytes per model structure, largest peak first\n";
+        report << left << setw(34) << "structure" << right << setw(14) << "peak" << setw(14) << "atFinish"
+               << setw(8) << "share" << "\n";
+        for (auto &account : accounts) {
+            report << left << setw(34) << account.first << right << setw(14) << account.second.peak
+                   << setw(14) << account.second.current << setw(7) << fixed << setprecision(1)
+                   << (peakSum > 0 ? 100.0 * account.second.peak / peakSum : 0.0) << "%\n";
+        }
+    }
+
+    void openFile() {
+        out.open(metricsFile, ios::trunc);
+        if (!out.is_open()) {
+            throw cRuntimeError("Cannot open metrics file %s", metricsFile.c_str());
+        }
+        snapshotsInFile = 0;
+    }
+
+    void rotateFile() {
+        out.close();
+        string previous = metricsFile + ".1";
+        remove(previous.c_str());
+        rename(metricsFile.c_str(), previous.c_str());
+        openFile();
+    }
+
+    void writeSnapshot() {
+        if (snapshotsInFile >= maxSnapshots) {
+            rotateFile();
+        }
+
+        auto now = chrono::steady_clock::now();
+        double wallDelta = chrono::duration<double>(now - lastWallTime).count();
+        int64_t eventNumber = getSimulation()->getEventNumber();
+        wallSeconds += wallDelta;
+
+        double eventsPerSec = wallDelta > 0 ? (eventNumber - lastEventNumber) / wallDelta : 0.0;
+        double simRealRatio = wallDelta > 0 ? (simTime() - lastSimTime).dbl() / wallDelta : 0.0;
+
+        lastWallTime = now;
+        lastEventNumber = eventNumber;
+        lastSimTime = simTime();
+
+        // Column names and values, in a fixed order
+        vector<pair<string, double>> columns;
+        columns.push_back({"simTime", simTime().dbl()});
+        columns.push_back({"wallSeconds", wallSeconds});
+        columns.push_back({"events", (double)eventNumber});
+        columns.push_back({"eventsPerSec", eventsPerSec});
+        columns.push_back({"simRealRatio", simRealRatio});
+
+        MetricsRegistry *registry = MetricsRegistry::getShared();
+        for (auto &counter : registry->getCounters()) {
+            columns.push_back({counter.first, (double)counter.second});
+        }
+        for (auto &gauge : registry->getGauges()) {
+            columns.push_back({gauge.name, gauge.read()});
+        }
+        for (auto &account : MemoryAccounting::getShared()->getAccounts()) {
+            columns.push_back({"mem." + account.first, (double)account.second.current});
+        }
+
+        stringstream line;
+        line << setprecision(10);
+        if (json) {
+            line << "{";
+            for (size_t i = 0; i < columns.size(); i++) {
+                line << (i > 0 ? ", " : "") << "\"" << columns[i].first << "\": " << columns[i].second;
+            }
+            line << "}";
+        } else {
+            if (snapshotsInFile == 0) {
+                for (size_t i = 0; i < columns.size(); i++) {
+                    out << (i > 0 ? "," : "") << columns[i].first;
+                }
+                out << "\n";
+            }
+            for (size_t i = 0; i < columns.size(); i++) {
+                line << (i > 0 ? "," : "") << columns[i].second;
+            }
+        }
+
+        // Flushed per snapshot so the file can be followed live
+        out << line.str() << endl;
+        snapshotsInFile++;
+        snapshotsWritten++;
+    }
+};
+
+Define_Module(MetricsExporter);
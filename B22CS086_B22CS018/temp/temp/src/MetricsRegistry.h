@@ -0,0 +1,55 @@
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Live values the MetricsExporter samples during a run. Modules register
+// gauges (read only when a snapshot is taken, so they cost nothing per event)
+// and bump shared counters through a pointer obtained once at initialize().
+class MetricsRegistry {
+public:
+    struct Gauge {
+        const void *owner;
+        std::string name;
+        std::function<double()> read;
+    };
+
+private:
+    std::vector<Gauge> gauges;
+
+    // std::map keeps the counter addresses stable
+    std::map<std::string, long> counters;
+
+    MetricsRegistry() {}
+
+public:
+    static MetricsRegistry *getShared() {
+        static MetricsRegistry *instance = new MetricsRegistry();
+        return instance;
+    }
+
+    void addGauge(const void *owner, const std::string &name, std::function<double()> read) {
+        gauges.push_back({owner, name, read});
+    }
+
+    // Called from the owner's destructor, before the gauge would dangle
+    void removeGauges(const void *owner) {
+        gauges.erase(std::remove_if(gauges.begin(), gauges.end(),
+                                    [owner](const Gauge &g) { return g.owner == owner; }),
+                     gauges.end());
+    }
+
+    // Shared counter, created at 0 on first use
+    long *counter(const std::string &name) {
+        return &counters[name];
+    }
+
+    const std::vector<Gauge> &getGauges() const { return gauges; }
+    const std::map<std::string, long> &getCounters() const { return counters; }
+};
+
+#endif // METRICSREGISTRY_H
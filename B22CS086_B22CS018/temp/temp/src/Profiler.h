@@ -0,0 +1,298 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Hot-path timing of message handlers and their phases (parse, compute, vote,
+// serialize, log). Only compiled in when REMOTEEXEC_PROFILE is defined (build
+// with `make PROFILE=1`, see makefrag); otherwise PROFILE_SCOPE expands to
+// nothing and modules carry no profiler at all.
+//
+//   PROFILE_SCOPE("Client::vote");   // times the rest of the enclosing block
+//
+// Scopes nest, so a handler's time includes the phases inside it.
+
+#ifdef REMOTEEXEC_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_HAVE_RDTSC 1
+#endif
+
+// HDR-style log-linear histogram: 16 linear buckets per power of two, so any
+// value is recorded with at most ~6% error in a fixed 8 KB array
+class TickHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = 64 * SUB_BUCKETS;
+
+private:
+    uint64_t counts[BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t maxValue;
+
+    static int msb(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(value);
+#else
+        int bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    static int bucketOf(uint64_t value) {
+        if (value < (uint64_t)SUB_BUCKETS) {
+            return (int)value;
+        }
+        int shift = msb(value) - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + (int)((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Midpoint of the values falling into a bucket
+    static uint64_t valueOf(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return (uint64_t)bucket;
+        }
+        int shift = (bucket >> SUB_BITS) - 1;
+        uint64_t low = (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+        return low + ((uint64_t)1 << shift) / 2;
+    }
+
+public:
+    TickHistogram() {
+        std::fill(counts, counts + BUCKETS, 0);
+        count = 0;
+        total = 0;
+        maxValue = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        count++;
+        total += value;
+        maxValue = std::max(maxValue, value);
+    }
+
+    void merge(const TickHistogram &other) {
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        count += other.count;
+        total += other.total;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    uint64_t getCount() const { return count; }
+    uint64_t getTotal() const { return total; }
+    uint64_t getMax() const { return maxValue; }
+
+    uint64_t quantile(double q) const {
+        uint64_t rank = (uint64_t)(q * count);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                return std::min(valueOf(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+};
+
+class Profiler {
+private:
+    // Indexed by phase id, grown on first use of a phase in this module
+    std::vector<TickHistogram *> phases;
+
+    static std::vector<std::string> &phaseNames() {
+        static std::vector<std::string> *names = new std::vector<std::string>();
+        return *names;
+    }
+
+    // All modules' histograms merged by phase, for the end-of-run report
+    static std::map<std::string, TickHistogram> &totals() {
+        static std::map<std::string, TickHistogram> *merged = new std::map<std::string, TickHistogram>();
+        return *merged;
+    }
+
+    // Profilers alive; the totals restart with the first module of a new run
+    static int &liveProfilers() {
+        static int count = 0;
+        return count;
+    }
+
+    struct Calibration {
+        uint64_t ticks;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    static const Calibration &calibrationStart() {
+        static Calibration start = {readTicks(), std::chrono::steady_clock::now()};
+        return start;
+    }
+
+public:
+    Profiler() {
+        calibrationStart();
+        if (liveProfilers()++ == 0) {
+            totals().clear();
+        }
+    }
+
+    ~Profiler() {
+        liveProfilers()--;
+        for (TickHistogram *histogram : phases) {
+            delete histogram;
+        }
+    }
+
+    static uint64_t readTicks() {
+#ifdef PROFILER_HAVE_RDTSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Ticks per nanosecond, measured since the first profiler was created
+    static double ticksPerNanosecond() {
+#ifdef PROFILER_HAVE_RDTSC
+        const Calibration &start = calibrationStart();
+        double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start.time).count();
+        return nanoseconds > 0 ? (readTicks() - start.ticks) / nanoseconds : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+
+    // Process-wide id of a phase name; called once per PROFILE_SCOPE site
+    static int phaseId(const char *name) {
+        std::vector<std::string> &names = phaseNames();
+        for (int i = 0; i < (int)names.size(); i++) {
+            if (names[i] == name) {
+                return i;
+            }
+        }
+        names.push_back(name);
+        return (int)names.size() - 1;
+    }
+
+    void record(int phase, uint64_t ticks) {
+        if (phase >= (int)phases.size()) {
+            phases.resize(phase + 1, nullptr);
+        }
+        if (phases[phase] == nullptr) {
+            phases[phase] = new TickHistogram();
+        }
+        phases[phase]->record(ticks);
+    }
+
+    class Scope {
+    private:
+        Profiler &profiler;
+        int phase;
+        uint64_t start;
+
+    public:
+        Scope(Profiler &profiler, int phase) : profiler(profiler), phase(phase), start(readTicks()) {}
+        ~Scope() { profiler.record(phase, readTicks() - start); }
+    };
+
+    // Record this module's phases as scalars through recordScalar(name, value), merge
+    // them into the run totals and rewrite the report sorted by total cost
+    template <typename Recorder>
+    void finish(Recorder recordScalar, const std::string &reportFile) {
+        double perNs = ticksPerNanosecond();
+        std::map<std::string, TickHistogram> &merged = totals();
+        for (int i = 0; i < (int)phases.size(); i++) {
+            if (phases[i] == nullptr) {
+                continue;
+            }
+            const std::string &name = phaseNames()[i];
+            recordScalar("profile." + name + ".count", (double)phases[i]->getCount());
+            recordScalar("profile." + name + ".totalNs", phases[i]->getTotal() / perNs);
+            recordScalar("profile." + name + ".p99Ns", phases[i]->quantile(0.99) / perNs);
+            merged[name].merge(*phases[i]);
+        }
+        writeReport(reportFile, perNs);
+    }
+
+    static void writeReport(const std::string &reportFile, double perNs) {
+        std::vector<std::pair<std::string, const TickHistogram *>> rows;
+        uint64_t grandTotal = 0;
+        for (auto &entry : totals()) {
+            rows.push_back({entry.first, &entry.second});
+        }
+        std::sort(rows.begin(), rows.end(), [](const std::pair<std::string, const TickHistogram *> &a,
+                                               const std::pair<std::string, const TickHistogram *> &b) {
+            return a.second->getTotal() > b.second->getTotal();
+        });
+        for (auto &row : rows) {
+            grandTotal = std::max(grandTotal, row.second->getTotal());
+        }
+
+        std::ofstream out(reportFile, std::ios::trunc);
+        if (!out.is_open()) {
+            return;
+        }
+        out << "# Handler and phase timings of all modules, sorted by total cost (times in ns,\n"
+            << "# handlers include the phases they contain; share is relative to the costliest row)\n";
+        out << std::left << std::setw(36) << "phase" << std::right
+            << std::setw(10) << "count" << std::setw(16) << "total" << std::setw(8) << "share"
+            << std::setw(12) << "mean" << std::setw(12) << "p50" << std::setw(12) << "p99"
+            << std::setw(12) << "max" << "\n";
+        out << std::fixed << std::setprecision(0);
+        for (auto &row : rows) {
+            const TickHistogram &h = *row.second;
+            double total = h.getTotal() / perNs;
+            out << std::left << std::setw(36) << row.first << std::right
+                << std::setw(10) << h.getCount()
+                << std::setw(16) << total
+                << std::setw(7) << (grandTotal > 0 ? 100.0 * h.getTotal() / grandTotal : 0.0) << "%"
+                << std::setw(12) << (h.getCount() > 0 ? total / h.getCount() : 0.0)
+                << std::setw(12) << h.quantile(0.50) / perNs
+                << std::setw(12) << h.quantile(0.99) / perNs
+                << std::setw(12) << h.getMax() / perNs << "\n";
+        }
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profilePhase, __LINE__) = Profiler::phaseId(name); \
+    Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(profiler, PROFILE_CONCAT(profilePhase, __LINE__))
+
+// Declares the module's profiler and writes its part of the report
+#define PROFILER_MEMBER Profiler profiler;
+#define PROFILE_FINISH() \
+    profiler.finish([this](const std::string &name, double value) { recordScalar(name.c_str(), value); }, "profile.txt")
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILER_MEMBER
+#define PROFILE_FINISH()
+
+#endif // REMOTEEXEC_PROFILE
+
+#endif // PROFILER_H
@@ -0,0 +1,330 @@
+#ifndef REPUTATIONTABLE_H
+#define REPUTATIONTABLE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Everything a client knows about the servers, stored as one column per field.
+// Dense mode has a row for every server, indexed directly by serverId. Sparse
+// mode only adds a row when a server is first observed, so a client that
+// talks to a few servers out of thousands stays small.
+//
+// The gossiped totals are a G-counter per server: every client (origin) owns
+// one cumulative score and subtask count per server, replicas merge them with
+// max, and the total is their sum. Merging is idempotent and order
+// independent, so duplicated, reordered or lost gossip cannot skew averages.
+class ReputationTable {
+private:
+    bool sparse;
+    int numServers;
+
+    // Sparse mode only: serverId of each row and the reverse lookup
+    std::vector<int> rowServer;
+    std::unordered_map<int, int> serverRow;
+
+    // Current task
+    std::vector<int> taskScore;     // correct results
+    std::vector<int> taskCount;     // subtasks given
+
+    // Per-origin counters, only ever merged upwards. Only the (origin, server)
+    // pairs that were ever reported are stored, keyed by originKey.
+    struct OriginCounter {
+        int score;
+        int count;
+    };
+    int numOrigins;
+    std::unordered_map<uint64_t, OriginCounter> originCounters;
+
+    static uint64_t originKey(int origin, int serverId) {
+        return ((uint64_t)(uint32_t)origin << 32) | (uint32_t)serverId;
+    }
+
+    OriginCounter originCounter(int origin, int row) const {
+        auto it = originCounters.find(originKey(origin, serverAt(row)));
+        return it == originCounters.end() ? OriginCounter{0, 0} : it->second;
+    }
+
+    // Sum over the origins plus the loaded snapshot (see load)
+    std::vector<int> totalScore;
+    std::vector<int> totalCount;
+    std::vector<double> avgScore;   // totalScore / totalCount, used for ranking
+
+    // Smoothed elements/s measured from replies (0 = not measured yet)
+    std::vector<double> throughput;
+
+    void resizeColumns(size_t rows) {
+        taskScore.resize(rows, 0);
+        taskCount.resize(rows, 0);
+        totalScore.resize(rows, 0);
+        totalCount.resize(rows, 0);
+        avgScore.resize(rows, 0.0);
+        throughput.resize(rows, 0.0);
+    }
+
+    void addTotals(int row, int score, int subtaskCount) {
+        totalScore[row] += score;
+        totalCount[row] += subtaskCount;
+        avgScore[row] = totalCount[row] > 0 ? (double)totalScore[row] / totalCount[row] : 0.0;
+    }
+
+public:
+    ReputationTable() : sparse(false), numServers(0), numOrigins(0) {}
+
+    void configure(int serverCount, int clientCount, bool sparseMode) {
+        numServers = serverCount;
+        sparse = sparseMode;
+        rowServer.clear();
+        serverRow.clear();
+        resizeColumns(0);
+        numOrigins = clientCount;
+        originCounters.clear();
+        if (!sparse) {
+            resizeColumns(numServers);
+        }
+    }
+
+    bool isSparse() const { return sparse; }
+    int rows() const { return (int)taskScore.size(); }
+    int serverAt(int row) const { return sparse ? rowServer[row] : row; }
+
+    // Row of a server, or -1 if it has never been observed
+    int findRow(int serverId) const {
+        if (!sparse) {
+            return serverId;
+        }
+        auto it = serverRow.find(serverId);
+        return it == serverRow.end() ? -1 : it->second;
+    }
+
+    // Row of a server, adding one in sparse mode
+    int rowOf(int serverId) {
+        if (!sparse) {
+            return serverId;
+        }
+        auto it = serverRow.find(serverId);
+        if (it != serverRow.end()) {
+            return it->second;
+        }
+        int row = rows();
+        rowServer.push_back(serverId);
+        serverRow[serverId] = row;
+        resizeColumns(row + 1);
+        return row;
+    }
+
+    // Row accessors
+    int getTaskScore(int row) const { return taskScore[row]; }
+    int getTaskCount(int row) const { return taskCount[row]; }
+    int getTotalScore(int row) const { return totalScore[row]; }
+    int getTotalCount(int row) const { return totalCount[row]; }
+    double getAvgScore(int row) const { return avgScore[row]; }
+
+    void resetTask() {
+        std::fill(taskScore.begin(), taskScore.end(), 0);
+        std::fill(taskCount.begin(), taskCount.end(), 0);
+    }
+
+    void addTaskScore(int serverId, int correct) {
+        taskScore[rowOf(serverId)] += correct;
+    }
+
+    void addTaskSubtask(int serverId) {
+        taskCount[rowOf(serverId)]++;
+    }
+
+    // A subtask given to one server was computed by another (work stealing)
+    void moveTaskSubtask(int fromServerId, int toServerId) {
+        int from = findRow(fromServerId);
+        if (from >= 0 && taskCount[from] > 0) {
+            taskCount[from]--;
+        }
+        taskCount[rowOf(toServerId)]++;
+    }
+
+    int origins() const { return numOrigins; }
+    int getOriginScore(int origin, int row) const { return originCounter(origin, row).score; }
+    int getOriginCount(int origin, int row) const { return originCounter(origin, row).count; }
+
+    // Fold the current task's scores into this client's own counters and
+    // start the next task from zero. Replies that arrive after a task was
+    // committed still add to taskScore and go out with the next commit.
+    void commitTask(int origin) {
+        for (int row = 0; row < rows(); row++) {
+            if (taskCount[row] > 0 || taskScore[row] > 0) {
+                OriginCounter own = originCounter(origin, row);
+                mergeOrigin(origin, serverAt(row), own.score + taskScore[row], own.count + taskCount[row]);
+            }
+        }
+        resetTask();
+    }
+
+    // Merge an origin's cumulative counters for a server; false if they were
+    // not newer than what this table already has
+    bool mergeOrigin(int origin, int serverId, int score, int subtaskCount) {
+        if (origin < 0 || origin >= origins()) {
+            return false;
+        }
+        auto it = originCounters.find(originKey(origin, serverId));
+        OriginCounter known = it == originCounters.end() ? OriginCounter{0, 0} : it->second;
+        int scoreGain = std::max(0, score - known.score);
+        int countGain = std::max(0, subtaskCount - known.count);
+        if (scoreGain == 0 && countGain == 0) {
+            return false;
+        }
+        originCounters[originKey(origin, serverId)] = OriginCounter{known.score + scoreGain, known.count + countGain};
+        addTotals(rowOf(serverId), scoreGain, countGain);
+        return true;
+    }
+
+    double getThroughput(int serverId) const {
+        int row = findRow(serverId);
+        return row < 0 ? 0.0 : throughput[row];
+    }
+
+    void setThroughput(int serverId, double value) {
+        throughput[rowOf(serverId)] = value;
+    }
+
+    // Mean of the measured throughputs, 0 if none has been measured
+    double meanThroughput() const {
+        double sum = 0;
+        int count = 0;
+        for (double value : throughput) {
+            if (value > 0) {
+                sum += value;
+                count++;
+            }
+        }
+        return count > 0 ? sum / count : 0.0;
+    }
+
+    // Estimated bytes held by the columns and the sparse row index
+    size_t memoryBytes() const {
+        size_t bytes = taskScore.capacity() * (4 * sizeof(int) + 2 * sizeof(double));
+        bytes += originCounters.size() * (sizeof(uint64_t) + sizeof(OriginCounter) + 3 * sizeof(void *));
+        bytes += originCounters.bucket_count() * sizeof(void *);
+        bytes += rowServer.capacity() * sizeof(int);
+        bytes += serverRow.size() * (2 * sizeof(int) + 3 * sizeof(void *));
+        return bytes;
+    }
+
+    // Snapshot of the aggregated state (totals and throughput) for a warm
+    // start. The loaded totals become a local base under the counters and are
+    // not gossiped again. Layout: the magic "RXRP", the server count and the row count, then per
+    // observed row serverId, totalScore, totalCount and throughput
+    void save(std::ostream &out) const {
+        int32_t observed = 0;
+        for (int row = 0; row < rows(); row++) {
+            if (totalCount[row] > 0 || throughput[row] > 0) {
+                observed++;
+            }
+        }
+        int32_t header[2] = {numServers, observed};
+        out.write("RXRP", 4);
+        out.write((const char *)header, sizeof(header));
+        for (int row = 0; row < rows(); row++) {
+            if (totalCount[row] == 0 && throughput[row] == 0) {
+                continue;
+            }
+            int32_t fields[3] = {serverAt(row), totalScore[row], totalCount[row]};
+            out.write((const char *)fields, sizeof(fields));
+            out.write((const char *)&throughput[row], sizeof(double));
+        }
+    }
+
+    // Add a snapshot's totals and take its throughputs; returns the rows read.
+    // Servers beyond this network's numServers are skipped.
+    int load(std::istream &in) {
+        char magic[4];
+        int32_t header[2];
+        in.read(magic, 4);
+        in.read((char *)header, sizeof(header));
+        if (!in || std::string(magic, 4) != "RXRP" || header[1] < 0) {
+            throw std::runtime_error("Not a reputation snapshot");
+        }
+        for (int32_t i = 0; i < header[1]; i++) {
+            int32_t fields[3];
+            double rate;
+            in.read((char *)fields, sizeof(fields));
+            in.read((char *)&rate, sizeof(rate));
+            if (!in) {
+                throw std::runtime_error("Reputation snapshot is truncated");
+            }
+            if (fields[0] < 0 || fields[0] >= numServers) {
+                continue;
+            }
+            addTotals(rowOf(fields[0]), fields[1], fields[2]);
+            if (rate > 0) {
+                setThroughput(fields[0], rate);
+            }
+        }
+        return header[1];
+    }
+
+    // Highest minus lowest average score; unobserved servers count as 0
+    double avgScoreSpread() const {
+        if (avgScore.empty()) {
+            return 0.0;
+        }
+        double lowest = *std::min_element(avgScore.begin(), avgScore.end());
+        double highest = *std::max_element(avgScore.begin(), avgScore.end());
+        if (rows() < numServers) {
+            lowest = std::min(lowest, 0.0);
+            highest = std::max(highest, 0.0);
+        }
+        return highest - lowest;
+    }
+
+    // The count best servers by (average score, serverId), both descending.
+    // Servers without a row rank with an average of 0.
+    std::vector<int> topServers(int count) const {
+        std::vector<std::pair<double, int>> ranked;
+        ranked.reserve(rows());
+        for (int row = 0; row < rows(); row++) {
+            ranked.push_back({avgScore[row], serverAt(row)});
+        }
+
+        int keep = std::min(count, (int)ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                          std::greater<std::pair<double, int>>());
+        ranked.resize(keep);
+
+        std::vector<int> top;
+        if (!sparse) {
+            for (auto &p : ranked) {
+                top.push_back(p.second);
+            }
+            return top;
+        }
+
+        // Merge in the unobserved servers, highest id first
+        size_t next = 0;
+        int unobserved = numServers - 1;
+        while ((int)top.size() < count) {
+            while (unobserved >= 0 && findRow(unobserved) >= 0) {
+                unobserved--;
+            }
+            bool haveRanked = next < ranked.size();
+            if (!haveRanked && unobserved < 0) {
+                break;
+            }
+            if (haveRanked && (unobserved < 0 || ranked[next] > std::make_pair(0.0, unobserved))) {
+                top.push_back(ranked[next++].second);
+            } else {
+                top.push_back(unobserved--);
+            }
+        }
+        return top;
+    }
+};
+
+#endif // REPUTATIONTABLE_H
@@ -0,0 +1,174 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+// Kernels whose verified results can be cached
+enum KernelKind {
+    KERNEL_MAX = 0
+};
+
+// LRU cache of majority-verified subtask results, keyed by a content hash of
+// the subtask payload and the kernel that was run on it
+class ResultCache {
+private:
+    struct Key {
+        uint64_t hash;
+        uint32_t length;
+        int kernel;
+
+        bool operator==(const Key &other) const {
+            return hash == other.hash && length == other.length && kernel == other.kernel;
+        }
+    };
+
+    struct KeyHasher {
+        size_t operator()(const Key &key) const {
+            return (size_t)(key.hash ^ ((uint64_t)key.length << 32) ^ (uint64_t)key.kernel);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        int result;
+    };
+
+    // Most recently used entry at the front
+    std::list<Entry> entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHasher> index;
+
+    // Maximum number of entries kept (0 disables the cache)
+    size_t capacity;
+
+    long hits;
+    long misses;
+    long evictions;
+
+    static Key makeKey(const int *data, size_t length, int kernel) {
+        Key key;
+        key.hash = hashPayload(data, length);
+        key.length = (uint32_t)length;
+        key.kernel = kernel;
+        return key;
+    }
+
+    static int &sharedUsers() {
+        static int users = 0;
+        return users;
+    }
+
+public:
+    explicit ResultCache(size_t capacity = 0)
+        : capacity(capacity), hits(0), misses(0), evictions(0) {}
+
+    // Cache shared by every client in the simulation
+    static ResultCache* getShared() {
+        static ResultCache* instance = nullptr;
+        if (instance == nullptr) {
+            instance = new ResultCache();
+        }
+        return instance;
+    }
+
+    // Clients attach in their constructor; the first one of a run empties the
+    // shared cache, so runs of a sweep do not start warm from the previous one
+    static void attachShared() {
+        if (sharedUsers()++ == 0) {
+            getShared()->clear();
+        }
+    }
+
+    static void detachShared() {
+        sharedUsers()--;
+    }
+
+    // 64-bit FNV-1a over whole 32-bit words of the payload
+    static uint64_t hashPayload(const int *data, size_t length) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (uint32_t)data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    void setCapacity(size_t count) {
+        capacity = count;
+        while (entries.size() > capacity) {
+            evictOldest();
+        }
+    }
+
+    // Look up a verified result, refreshing its position on a hit
+    bool lookup(const int *data, size_t length, int kernel, int &result) {
+        if (capacity == 0) {
+            return false;
+        }
+
+        auto it = index.find(makeKey(data, length, kernel));
+        if (it == index.end()) {
+            misses++;
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        result = it->second->result;
+        hits++;
+        return true;
+    }
+
+    // Store a verified result, evicting the least recently used entry when full
+    void insert(const int *data, size_t length, int kernel, int result) {
+        if (capacity == 0) {
+            return;
+        }
+
+        Key key = makeKey(data, length, kernel);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->result = result;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+
+        if (entries.size() >= capacity) {
+            evictOldest();
+        }
+
+        entries.push_front(Entry{key, result});
+        index[key] = entries.begin();
+    }
+
+    void evictOldest() {
+        if (entries.empty()) {
+            return;
+        }
+        index.erase(entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // Estimated bytes held: list node plus index node per entry
+    size_t memoryBytes() const {
+        return entries.size() * (sizeof(Entry) + 2 * sizeof(void *) +
+                                 sizeof(Key) + sizeof(std::list<Entry>::iterator) + 3 * sizeof(void *));
+    }
+    long getHits() const { return hits; }
+    long getMisses() const { return misses; }
+    long getEvictions() const { return evictions; }
+};
+
+#endif // RESULTCACHE_H
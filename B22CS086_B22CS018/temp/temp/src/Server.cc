@@ -4,19 +4,155 @@
 #include <algorithm>
 #include <fstream>
 #include <map>
+#include <deque>
+#include <tuple>
+#include <cstdlib>
+#include <iterator>
+#include <chrono>
+#include <climits>
 #include "MasterServer.h"
+#include "MessagePool.h"
+#include "MetricsRegistry.h"
+#include "Profiler.h"
+#include "Logging.h"
+#include "MemoryAccounting.h"
+#include "KernelExecutor.h"
+#include "MapReduce.h"
 
 using namespace omnetpp;
 using namespace std;
 
 const string OUTPUT = "output.txt";
 
+// Bytes of a ShuffleMessage besides its counts (ids and routing)
+const int SHUFFLE_HEADER_BYTES = 24;
+
 class Server : public cSimpleModule
 {
 protected:
     // Reference to the MasterServer
     MasterServer* masterServer;
 
+    // Time needed per array element; 0 serves every subtask instantly
+    simtime_t serviceTimePerElement;
+
+    // Subtasks waiting while another one is in service, in arrival order
+    deque<cMessage*> taskQueue;
+
+    // Batching: up to batchSize subtasks are collected, for at most batchWindow
+    // after the first one, and computed in one kernel pass
+    int batchSize;
+    simtime_t batchWindow;
+    simtime_t batchOverhead;  // fixed cost of a kernel pass
+    vector<cMessage*> batch;  // collected, not yet computed
+    cMessage *batchTimer;
+    vector<int> batchValues;  // data of every subtask of the batch, back to back
+    vector<size_t> batchOffsets;  // start of each subtask in batchValues
+    vector<size_t> batchMessages; // first subtask of each batched message
+    cHistogram batchSizeStats;
+    cHistogram serverLatencyStats; // arrival of a subtask to its result leaving
+    cHistogram shuffleLatencyStats; // arrival of a map subtask to one of its partitions leaving
+    int batchesRun;
+
+    // Results of the batch in service, released when serviceDone fires
+    struct PendingResult {
+        cMessage *result;
+        int gate;
+        simtime_t arrival;
+    };
+    vector<PendingResult> resultsInService;
+    int tasksInService;
+    cMessage *serviceDone;
+
+    // Per client link: when the replies already queued on it are transmitted
+    vector<simtime_t> linkFreeAt;
+
+    // Running maximum of a fragmented subtask
+    struct PartialResult {
+        int max;
+        int received;  // fragments reduced so far
+
+        PartialResult() : max(0), received(0) {}
+    };
+
+    // (clientId, taskId, subtaskId) -> partial result of fragments received so far
+    map<tuple<int, int, int>, PartialResult> partialResults;
+    long partialResultsExpired;
+
+    // MapReduce jobs: (clientId, taskId, partition) -> shuffle inputs of a reduce partition
+    map<tuple<int, int, int>, MapReduce::ShuffleCollector> shuffles;
+    int shuffleMessagesSent;
+    long shuffleBytesSent;
+    int reducesRun;
+
+    simtime_t busyTime;
+    int subtasksServed;
+    int bundlesServed; // coalesced TaskMessages carrying several subtasks
+
+    // Hybrid execution: kernels run on the host thread pool and their measured
+    // wall-clock time, times measuredTimeScale, is the simulated service time
+    KernelExecutor *executor; // nullptr = service time from serviceTimePerElement
+    double measuredTimeScale;
+    double kernelWallSeconds;   // measured, summed over all batches
+    double modelServiceSeconds; // what serviceTimePerElement would have given
+    cHistogram measuredToModelStats;
+
+    // Work stealing: a server that runs out of work asks random peers for a
+    // queued subtask it does not already hold a replica of
+    bool workStealing;
+    int stealAttempts;  // victims asked in a row per round
+    cMessage *stealTimer;       // next round while idle, with exponential backoff
+    simtime_t stealBackoff;     // first interval, and the one after new work
+    simtime_t stealBackoffMax;
+    simtime_t stealInterval;    // current interval
+    long *clientsFinished;      // shared by all clients; idle servers stop probing once all are done
+    int stealRequests;  // sent as thief
+    int stealProbes;    // rounds started by stealTimer while idle
+    int tasksStolen;    // received as thief
+    int tasksGivenAway; // handed over as victim
+
+    // Injected faults: a crashed server drops everything it receives
+    bool crashed;
+    double slowdown;
+    int tasksDropped;   // arrived or queued while crashed
+    int packetsLost;    // corrupted by a lossy link
+
+    // Received TaskMessages are recycled into ResultMessages
+    MessagePool pool;
+
+    // Handler timings, only with REMOTEEXEC_PROFILE
+    PROFILER_MEMBER
+
+    // Memory accounts shared by all servers
+    MemoryAccounting::Account *queueMemory;
+    MemoryAccounting::Account *partialResultMemory;
+    MemoryAccounting::Account *shuffleMemory;
+    MemoryAccounting::Account *masterServerMemory;
+    MemoryAccounting::Account *taskPayloadMemory; // TaskMessages in flight
+
+public:
+    Server() : batchTimer(nullptr), serviceDone(nullptr), stealTimer(nullptr) {
+        MemoryAccounting::getShared()->attach();
+    }
+
+    ~Server() {
+        MetricsRegistry::getShared()->removeGauges(this);
+        MemoryAccounting::getShared()->detach();
+        cancelAndDelete(serviceDone);
+        cancelAndDelete(batchTimer);
+        cancelAndDelete(stealTimer);
+        for (PendingResult &pending : resultsInService) {
+            delete pending.result;
+        }
+        for (cMessage *task : batch) {
+            delete task;
+        }
+        for (cMessage *task : taskQueue) {
+            delete task;
+        }
+    }
+
+protected:
     void initialize() override {
         // Get the MasterServer instance
         masterServer = MasterServer::getInstance();
@@ -24,88 +160,839 @@ protected:
         // Set the total number of servers (only needed once, but safe to call multiple times)
         int numServers = getParentModule()->par("numServers");
         masterServer->setTotalServers(numServers);
+
+        serviceTimePerElement = par("serviceTimePerElement").doubleValue();
+        tasksInService = 0;
+        serviceDone = new cMessage("ServiceDone");
+
+        batchSize = par("batchSize");
+        batchWindow = par("batchWindow").doubleValue();
+        batchOverhead = par("batchOverhead").doubleValue();
+        if (batchSize < 1) {
+            throw cRuntimeError("batchSize must be at least 1");
+        }
+        batchTimer = new cMessage("BatchWindow");
+        batchSizeStats.setName("batchSize");
+        serverLatencyStats.setName("serverLatency");
+        shuffleLatencyStats.setName("shuffleLatency");
+        batchesRun = 0;
+
+        string backend = par("computeBackend").stdstringValue();
+        if (backend == "threads") {
+            executor = KernelExecutor::getShared(par("kernelThreads").intValue());
+        } else if (backend == "model") {
+            executor = nullptr;
+        } else {
+            throw cRuntimeError("Unknown computeBackend '%s' (expected model or threads)", backend.c_str());
+        }
+        measuredTimeScale = par("measuredTimeScale").doubleValue();
+        kernelWallSeconds = 0;
+        modelServiceSeconds = 0;
+        measuredToModelStats.setName("measuredToModelServiceTime");
+
+        workStealing = getParentModule()->par("workStealing");
+        stealAttempts = par("stealAttempts");
+        stealBackoff = par("stealBackoff").doubleValue();
+        stealBackoffMax = par("stealBackoffMax").doubleValue();
+        stealInterval = stealBackoff;
+        stealTimer = new cMessage("StealProbe");
+        clientsFinished = MetricsRegistry::getShared()->counter("clientsFinished");
+        if (workStealing) {
+            // Servers nobody selected are idle from the start
+            scheduleAt(simTime() + stealBackoff, stealTimer);
+        }
+        stealRequests = 0;
+        stealProbes = 0;
+        tasksStolen = 0;
+        tasksGivenAway = 0;
+        pool.setCapacity(par("messagePoolCapacity").intValue());
+        busyTime = 0;
+        subtasksServed = 0;
+        bundlesServed = 0;
+        partialResultsExpired = 0;
+        linkFreeAt.assign(gateSize("out"), SIMTIME_ZERO);
+        shuffleMessagesSent = 0;
+        shuffleBytesSent = 0;
+        reducesRun = 0;
+        crashed = false;
+        slowdown = 1.0;
+        tasksDropped = 0;
+        packetsLost = 0;
+
+        MemoryAccounting *memory = MemoryAccounting::getShared();
+        queueMemory = memory->account("server.taskQueue");
+        partialResultMemory = memory->account("server.partialResults");
+        shuffleMemory = memory->account("server.shuffleInputs");
+        masterServerMemory = memory->account("masterServer.maliciousServers");
+        taskPayloadMemory = memory->account("inFlight.taskPayload");
+
+        // Subtasks queued or in service, sampled by the MetricsExporter
+        MetricsRegistry::getShared()->addGauge(this, string(getFullName()) + ".queueDepth", [this]() {
+            return (double)(taskQueue.size() + batch.size() + tasksInService);
+        });
     }
 
     void handleMessage(cMessage *msg) override {
-        if (strcmp(msg->getName(), "TaskMessage") == 0) {
-            int taskId = msg->par("taskId").longValue();
-            int subtaskId = msg->par("subtaskId").longValue();
-            string dataStr = msg->par("data").stringValue();
+        PROFILE_SCOPE("Server::handleMessage");
+        cPacket *pkt = dynamic_cast<cPacket *>(msg);
+        if (pkt != nullptr && strcmp(msg->getName(), "TaskMessage") == 0) {
+            taskPayloadMemory->add(-pkt->getByteLength());
+        }
+        if (pkt != nullptr && pkt->hasBitError()) {
+            // Lost on the link
+            packetsLost++;
+            pool.release(msg);
+        } else if (strcmp(msg->getName(), "FaultMessage") == 0) {
+            handleFault(msg);
+            pool.release(msg);
+        } else if (msg == stealTimer) {
+            probeForWork();
+        } else if (strcmp(msg->getName(), "StealRequest") == 0) {
+            handleStealRequest(msg);
+        } else if (strcmp(msg->getName(), "StealDenied") == 0) {
+            // Try another victim while still idle
+            int attempt = msg->par("attempt").longValue();
+            pool.release(msg);
+            if (!crashed && isIdle() && attempt < stealAttempts) {
+                requestSteal(attempt + 1);
+            }
+        } else if (crashed && msg != serviceDone && msg != batchTimer) {
+            tasksDropped++;
+            pool.release(msg);
+        } else if (msg == serviceDone) {
+            // The batch in service is finished, release its results
+            for (PendingResult &pending : resultsInService) {
+                sendResult(pending);
+            }
+            resultsInService.clear();
+            tasksInService = 0;
+
+            // Serve whatever queued up meanwhile; it has waited already, so
+            // the batches go without a window
+            while (!taskQueue.empty() && !serviceDone->isScheduled()) {
+                while (!taskQueue.empty() && (int)batch.size() < batchSize) {
+                    batch.push_back(taskQueue.front());
+                    taskQueue.pop_front();
+                }
+                runBatch();
+            }
 
-            // Get clientId from the arrival gate
-            int clientId = msg->getArrivalGate()->getIndex();
+            if (workStealing && isIdle()) {
+                requestSteal(1);
+                armStealTimer(true);
+            }
+        } else if (msg == batchTimer) {
+            // The window closed before the batch filled up
+            runBatch();
+        } else if (strcmp(msg->getName(), "TaskMessage") == 0) {
+            if (msg->hasPar("stolenFrom")) {
+                tasksStolen++;
+            }
+            enqueue(msg);
+        } else if (strcmp(msg->getName(), "ShuffleMessage") == 0) {
+            handleShuffleMessage(msg);
+        } else {
+            pool.release(msg);
+        }
+    }
 
-            // Check with MasterServer if this server should be malicious
-            bool isHonest = !masterServer->isServerMalicious(clientId, taskId, getIndex());
+    void finish() override {
+        recordScalar("busyTime", busyTime.dbl());
+        recordScalar("subtasksServed", subtasksServed);
+        recordScalar("bundlesServed", bundlesServed);
+        recordScalar("partialResultsExpired", partialResultsExpired);
+        recordScalar("tasksDropped", tasksDropped);
+        recordScalar("packetsLost", packetsLost);
+        recordScalar("batchesRun", batchesRun);
+        recordScalar("utilization", simTime() > SIMTIME_ZERO ? busyTime.dbl() / simTime().dbl() : 0.0);
+        if (executor != nullptr) {
+            recordScalar("kernelThreads", executor->getThreads());
+            recordScalar("kernelWallSeconds", kernelWallSeconds);
+            recordScalar("modelServiceSeconds", modelServiceSeconds);
+            measuredToModelStats.record();
+        }
+        if (shuffleMessagesSent > 0 || reducesRun > 0) {
+            recordScalar("shuffleMessagesSent", shuffleMessagesSent);
+            recordScalar("shuffleBytesSent", (double)shuffleBytesSent);
+            recordScalar("reducesRun", reducesRun);
+            shuffleLatencyStats.record();
+        }
+        if (workStealing) {
+            recordScalar("stealRequests", stealRequests);
+            recordScalar("stealProbes", stealProbes);
+            recordScalar("tasksStolen", tasksStolen);
+            recordScalar("tasksGivenAway", tasksGivenAway);
+        }
+        if (getIndex() == 0) {
+            recordUtilizationBalance();
+        }
+        recordScalar("subtasksPerBusySecond", busyTime > SIMTIME_ZERO ? subtasksServed / busyTime.dbl() : 0.0);
+        batchSizeStats.record();
+        serverLatencyStats.record();
+        PROFILE_FINISH();
+        recordScalar("messagePoolHitRate", pool.getHitRate());
+        recordScalar("messagesAllocated", pool.getMessagesAllocated());
+        recordScalar("messageParsAllocated", pool.getParsAllocated());
+        recordScalar("messageParsReused", pool.getParsReused());
+    }
 
-            istringstream iss(dataStr);
-            vector<int> data;
+    void handleFault(cMessage *msg) {
+        string fault = msg->par("fault").stringValue();
+        if (fault == "crash") {
+            crashed = true;
 
-            int value;
-            while (iss >> value) {
-                data.push_back(value);
+            // Everything in progress is lost
+            if (serviceDone->isScheduled()) {
+                cancelEvent(serviceDone);
+            }
+            if (batchTimer->isScheduled()) {
+                cancelEvent(batchTimer);
             }
+            for (PendingResult &pending : resultsInService) {
+                pool.release(pending.result);
+            }
+            resultsInService.clear();
+            tasksInService = 0;
+            tasksDropped += batch.size() + taskQueue.size();
+            for (cMessage *task : batch) {
+                queueMemory->add(-queuedBytes(task));
+                pool.release(task);
+            }
+            batch.clear();
+            for (cMessage *task : taskQueue) {
+                queueMemory->add(-queuedBytes(task));
+                pool.release(task);
+            }
+            taskQueue.clear();
+            partialResultMemory->add(-(long)(partialResults.size() * partialResultBytes()));
+            partialResults.clear();
+            for (auto &entry : shuffles) {
+                shuffleMemory->add(-entry.second.memoryBytes());
+            }
+            shuffles.clear();
+        } else if (fault == "restart") {
+            crashed = false;
+            if (workStealing) {
+                armStealTimer(true);
+            }
+        } else if (fault == "slowdown") {
+            slowdown = msg->par("factor").doubleValue();
+        }
+
+        ofstream out;
+        if (LOG_ENABLED(INFO)) {
+            out.open(OUTPUT, ios::app);
+        }
+        if (out.is_open()) {
+            out << "Server " << getIndex() << " fault: " << fault;
+            if (fault == "slowdown") {
+                out << " x" << slowdown;
+            }
+            out << "\n";
+            out.close();
+        }
+    }
+
+    // A queued TaskMessage: the packet object and its payload
+    static long queuedBytes(cMessage *msg) {
+        return sizeof(cPacket) + static_cast<cPacket *>(msg)->getByteLength();
+    }
+
+    static long partialResultBytes() {
+        return sizeof(tuple<int, int, int>) + sizeof(PartialResult) + MemoryAccounting::TREE_NODE_OVERHEAD;
+    }
+
+    // MapReduce subtasks carry their stage; plain ones have none
+    static bool isStage(cMessage *msg, const char *stage) {
+        return msg->hasPar("stage") && strcmp(msg->par("stage").stringValue(), stage) == 0;
+    }
+
+    bool isIdle() const {
+        return !serviceDone->isScheduled() && batch.empty() && taskQueue.empty();
+    }
+
+    // Client (and reply gate) of a subtask; a stolen one keeps its original client
+    static int clientGateOf(cMessage *msg) {
+        if (msg->hasPar("clientGate")) {
+            return msg->par("clientGate").longValue();
+        }
+        return msg->getArrivalGate()->getIndex();
+    }
+
+    // While idle, start a round of steal requests and back off before the next
+    void probeForWork() {
+        if (crashed || !isIdle()) {
+            return; // Re-armed once the server is idle again
+        }
+        int numClients = getParentModule()->par("numClients");
+        if (*clientsFinished >= numClients) {
+            return; // No client will dispatch anything any more
+        }
+        requestSteal(1);
+        stealProbes++;
+        stealInterval = min(stealInterval * 2, stealBackoffMax);
+        armStealTimer(false);
+    }
 
-            // Log received task
-            {
-                ofstream out(OUTPUT, ios::app);
-                if (!out.is_open()) {
-                    cout << "Error opening file " << OUTPUT << "\n";
-                    return;
-                } else {
+    void armStealTimer(bool newWork) {
+        if (newWork) {
+            stealInterval = stealBackoff;
+        }
+        if (!stealTimer->isScheduled()) {
+            scheduleAt(simTime() + stealInterval, stealTimer);
+        }
+    }
+
+    void requestSteal(int attempt) {
+        int numServers = getParentModule()->par("numServers");
+        if (numServers < 2) {
+            return;
+        }
+        int victim = intuniform(0, numServers - 2);
+        if (victim >= getIndex()) {
+            victim++; // Never ourselves
+        }
+
+        cMessage *request = pool.acquire("StealRequest");
+        pool.addPar(request, "thief") = getIndex();
+        pool.addPar(request, "attempt") = attempt;
+        sendDirect(request, getParentModule()->getSubmodule("server", victim), "stealIn");
+        stealRequests++;
+    }
+
+    // Hand the newest queued subtask the thief holds no replica of, if any.
+    // Fragments, coalesced bundles, MapReduce stages and already stolen
+    // subtasks stay where they are.
+    void handleStealRequest(cMessage *request) {
+        int thief = request->par("thief").longValue();
+        if (crashed) {
+            pool.release(request);
+            return;
+        }
+
+        string thiefId = to_string(thief);
+        for (auto it = taskQueue.rbegin(); it != taskQueue.rend(); ++it) {
+            cMessage *task = *it;
+            if (task->hasPar("fragments") || task->hasPar("subtaskIds") || task->hasPar("stage") ||
+                task->hasPar("stolenFrom") || holds(task, thiefId)) {
+                continue;
+            }
+
+            taskQueue.erase(next(it).base());
+            queueMemory->add(-queuedBytes(task));
+            taskPayloadMemory->add(static_cast<cPacket *>(task)->getByteLength());
+            pool.addPar(task, "clientGate") = task->getArrivalGate()->getIndex();
+            pool.addPar(task, "stolenFrom") = getIndex();
+            sendDirect(task, getParentModule()->getSubmodule("server", thief), "stealIn");
+            tasksGivenAway++;
+            pool.release(request);
+            return;
+        }
+
+        request->setName("StealDenied");
+        sendDirect(request, getParentModule()->getSubmodule("server", thief), "stealIn");
+    }
+
+    // Whether a server is in the subtask's replica list ("holders", e.g. "0,3,4")
+    static bool holds(cMessage *task, const string &serverId) {
+        if (!task->hasPar("holders")) {
+            return false;
+        }
+        istringstream holders(task->par("holders").stringValue());
+        string holder;
+        while (getline(holders, holder, ',')) {
+            if (holder == serverId) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Busiest server's busy time over the mean, and the spread, over all servers
+    void recordUtilizationBalance() {
+        cModule *network = getParentModule();
+        int numServers = network->par("numServers");
+        double total = 0, busiest = 0, idlest = -1;
+        for (int i = 0; i < numServers; i++) {
+            Server *server = check_and_cast<Server *>(network->getSubmodule("server", i));
+            double busy = server->busyTime.dbl();
+            total += busy;
+            busiest = max(busiest, busy);
+            idlest = (idlest < 0) ? busy : min(idlest, busy);
+        }
+        double mean = numServers > 0 ? total / numServers : 0.0;
+        recordScalar("busyTimeMaxOverMean", mean > 0 ? busiest / mean : 0.0);
+        recordScalar("busyTimeSpread", busiest - max(idlest, 0.0));
+    }
+
+    // Queue a subtask, or batch it right away when the server is idle
+    void enqueue(cMessage *msg) {
+        queueMemory->add(queuedBytes(msg));
+        if (serviceDone->isScheduled()) {
+            taskQueue.push_back(msg);
+        } else {
+            addToBatch(msg);
+        }
+    }
+
+    // One map replica's partition for a reduce partition this server holds.
+    // Once every map subtask has a majority, the message itself becomes the
+    // reduce subtask and is queued like one that came from the client.
+    void handleShuffleMessage(cMessage *msg) {
+        int clientId = msg->par("clientId").longValue();
+        int taskId = msg->par("taskId").longValue();
+        int partition = msg->par("partition").longValue();
+
+        // A client's shuffles of earlier tasks can no longer complete anything
+        auto first = shuffles.lower_bound(make_tuple(clientId, INT_MIN, INT_MIN));
+        auto last = shuffles.lower_bound(make_tuple(clientId, taskId, INT_MIN));
+        for (auto it = first; it != last; ++it) {
+            shuffleMemory->add(-it->second.memoryBytes());
+        }
+        shuffles.erase(first, last);
+
+        // A completed collector stays until then, so late replicas are dropped
+        auto key = make_tuple(clientId, taskId, partition);
+        auto it = shuffles.find(key);
+        long before = (it != shuffles.end()) ? it->second.memoryBytes() : 0;
+        MapReduce::ShuffleCollector &collector = (it != shuffles.end()) ? it->second : shuffles[key];
+        bool complete = !collector.isComplete() &&
+                        collector.add(msg->par("mapSubtasks").longValue(), msg->par("mapSubtask").longValue(),
+                                      msg->par("replicas").longValue(), msg->par("serverId").longValue(),
+                                      msg->par("data").stringValue());
+        shuffleMemory->add(collector.memoryBytes() - before);
+        if (!complete) {
+            pool.release(msg);
+            return;
+        }
+
+        // Queued as a TaskMessage, so it must not route like a shuffle any more
+        string input = collector.reduceInput();
+        pool.removePar(msg, "shuffleTo");
+        msg->setName("TaskMessage");
+        static_cast<cPacket *>(msg)->setByteLength(SHUFFLE_HEADER_BYTES + input.size());
+        msg->par("data") = input.c_str();
+        pool.addPar(msg, "stage") = "reduce";
+        pool.addPar(msg, "clientGate") = clientId;
+        pool.addPar(msg, "mapScores") = collector.getMapScores().c_str();
+        enqueue(msg);
+    }
+
+    // Collect a subtask that arrived while the server is idle
+    void addToBatch(cMessage *msg) {
+        batch.push_back(msg);
+        if ((int)batch.size() >= batchSize || batchWindow == SIMTIME_ZERO) {
+            runBatch();
+        } else if (!batchTimer->isScheduled()) {
+            scheduleAt(simTime() + batchWindow, batchTimer);
+        }
+    }
+
+    // Parse every subtask of the batch into one buffer, reduce all of them in
+    // a single pass over it, and hold the results for the batch's service time.
+    // A coalesced bundle is one batch entry holding several subtasks.
+    void runBatch() {
+        if (batchTimer->isScheduled()) {
+            cancelEvent(batchTimer);
+        }
+        if (batch.empty()) {
+            return;
+        }
+        batchesRun++;
+        batchSizeStats.collect(batch.size());
+
+        batchValues.clear();
+        batchOffsets.clear();
+        batchMessages.clear();
+        {
+            PROFILE_SCOPE("Server::parse");
+            for (cMessage *msg : batch) {
+                queueMemory->add(-queuedBytes(msg));
+                batchMessages.push_back(batchOffsets.size());
+
+                // The payloads of a bundle are separated by ';'
+                const char *data = msg->par("data").stringValue();
+                while (data != nullptr) {
+                    batchOffsets.push_back(batchValues.size());
+                    char *end;
+                    for (long value = strtol(data, &end, 10); end != data; value = strtol(data, &end, 10)) {
+                        batchValues.push_back((int)value);
+                        data = end;
+                    }
+                    data = strchr(data, ';');
+                    if (data != nullptr) {
+                        data++;
+                    }
+                }
+            }
+            batchMessages.push_back(batchOffsets.size());
+            batchOffsets.push_back(batchValues.size());
+        }
+
+        // Log received tasks
+        if (LOG_ENABLED(DEBUG)) {
+            PROFILE_SCOPE("Server::log");
+            ofstream out(OUTPUT, ios::app);
+            if (!out.is_open()) {
+                cout << "Error opening file " << OUTPUT << "\n";
+            } else {
+                for (cMessage *msg : batch) {
                     out << convertMsgToString(msg);
-                    out.close();
                 }
+                out.close();
             }
+        }
 
-            // Compute the maximum
-            int maxi = *max_element(data.begin(), data.end());
+        // Compute the maximum of every subtask, on the host cores in hybrid mode
+        size_t batchSubtasks = batchOffsets.size() - 1;
+        vector<int> maxima(batchSubtasks);
+        auto kernel = [this, &maxima](size_t i) {
+            const int *first = batchValues.data() + batchOffsets[i];
+            const int *last = batchValues.data() + batchOffsets[i + 1];
+            int maxi = first < last ? *first : 0;
+            for (const int *value = first; value < last; value++) {
+                maxi = max(maxi, *value);
+            }
+            maxima[i] = maxi;
+        };
+        double measuredSeconds = 0;
+        {
+            PROFILE_SCOPE("Server::compute");
+            if (executor != nullptr) {
+                // Each worker times its own kernel, so waking the pool and
+                // handing out the jobs is not counted as service time
+                vector<double> kernelSeconds(batchSubtasks);
+                executor->parallelFor(batchSubtasks, [&kernel, &kernelSeconds](size_t i) {
+                    auto start = chrono::steady_clock::now();
+                    kernel(i);
+                    kernelSeconds[i] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                });
+                measuredSeconds = parallelSeconds(kernelSeconds);
+            } else {
+                for (size_t i = 0; i < batchSubtasks; i++) {
+                    kernel(i);
+                }
+            }
+        }
 
-            // If malicious for this task, modify the result
-            if (!isHonest) {
-                maxi -= intuniform(1, 10); // Sabotage the result
+        for (size_t i = 0; i < batch.size(); i++) {
+            cMessage *msg = batch[i];
+            const int *first = batchValues.data() + batchOffsets[batchMessages[i]];
+            const int *last = batchValues.data() + batchOffsets[batchMessages[i] + 1];
+            cMessage *result;
+            if (isStage(msg, "map")) {
+                shuffleMap(msg, first, last);
+                result = nullptr; // Its shuffle messages are already pending
+            } else if (isStage(msg, "reduce")) {
+                result = completeReduce(msg, first, last);
+            } else if (msg->hasPar("subtaskIds")) {
+                result = completeBundle(msg, maxima.data() + batchMessages[i], batchMessages[i + 1] - batchMessages[i]);
+            } else {
+                result = completeSubtask(msg, maxima[batchMessages[i]]);
             }
+            PendingResult pending = {result, clientGateOf(msg), msg->getArrivalTime()};
+            if (pending.result != nullptr) {
+                resultsInService.push_back(pending);
+            }
+            pool.release(msg);
+        }
 
-            // Create and send a ResultMessage back
-            cMessage *rm = new cMessage("ResultMessage");
+        simtime_t serviceTime = SIMTIME_ZERO;
+        if (serviceTimePerElement > SIMTIME_ZERO || batchOverhead > SIMTIME_ZERO) {
+            serviceTime = batchOverhead + serviceTimePerElement * (slowdown * batchValues.size());
+        }
+        if (executor != nullptr) {
+            // Keep the model's prediction for comparison, then use the measurement
+            simtime_t measured = batchOverhead + measuredSeconds * measuredTimeScale * slowdown;
+            kernelWallSeconds += measuredSeconds;
+            modelServiceSeconds += serviceTime.dbl();
+            if (serviceTime > SIMTIME_ZERO) {
+                measuredToModelStats.collect(measured.dbl() / serviceTime.dbl());
+            }
+            serviceTime = measured;
+        }
+        tasksInService = batch.size();
+        batch.clear();
 
-            rm->addPar("taskId");
-            rm->par("taskId") = taskId;
+        if (serviceTime == SIMTIME_ZERO) {
+            for (PendingResult &pending : resultsInService) {
+                sendResult(pending);
+            }
+            resultsInService.clear();
+            tasksInService = 0;
+        } else {
+            // Hold the results until the service time has elapsed
+            busyTime += serviceTime;
+            scheduleAt(simTime() + serviceTime, serviceDone);
+        }
+    }
 
-            rm->addPar("subtaskId");
-            rm->par("subtaskId") = subtaskId;
+    // Time the pool needs for the measured kernels: their total spread over the
+    // threads, but no less than the longest kernel
+    double parallelSeconds(const vector<double> &kernelSeconds) const {
+        double total = 0;
+        double longest = 0;
+        for (double seconds : kernelSeconds) {
+            total += seconds;
+            longest = max(longest, seconds);
+        }
+        size_t lanes = min(kernelSeconds.size(), (size_t)executor->getThreads());
+        return lanes > 0 ? max(longest, total / lanes) : 0.0;
+    }
 
-            rm->addPar("result");
-            rm->par("result") = maxi;
+    // The ResultMessage of a computed subtask, or nullptr while fragments of it are missing
+    cMessage *completeSubtask(cMessage *msg, int maxi) {
+        int taskId = msg->par("taskId").longValue();
+        int subtaskId = msg->par("subtaskId").longValue();
 
-            rm->addPar("serverId");
-            rm->par("serverId") = getIndex();
+        // Get clientId from the arrival gate
+        int clientId = clientGateOf(msg);
 
-            string temp = "Result Server:" + to_string(getIndex()) +
-                " taskId:" + to_string(taskId) +
-                " subtaskId:" + to_string(subtaskId) +
-                " on gate:" + to_string(msg->getArrivalGate()->getIndex()) +
-                " result:" + to_string(maxi) +
-                " isHonest:" + (isHonest ? "true" : "false") + "\n";
+        // Check with MasterServer if this server should be malicious
+        bool isHonest = !masterServer->isServerMalicious(clientId, taskId, getIndex());
+        masterServerMemory->replace(masterServerMemory->current, masterServer->getStateBytes());
 
-            // Log sent result
-            {
-                ofstream out(OUTPUT, ios::app);
-                if (!out.is_open()) {
-                    cout << "Error opening file " << OUTPUT << "\n";
-                    return;
-                } else {
-                    out << temp;
-                    out.close();
-                }
+        // Fragments of a client's earlier tasks that never all arrived (lost or
+        // dropped on the way) can no longer complete a subtask
+        auto first = partialResults.lower_bound(make_tuple(clientId, INT_MIN, INT_MIN));
+        auto last = partialResults.lower_bound(make_tuple(clientId, taskId, INT_MIN));
+        if (first != last) {
+            long expired = distance(first, last);
+            partialResultsExpired += expired;
+            partialResultMemory->add(-expired * partialResultBytes());
+            partialResults.erase(first, last);
+        }
+
+        // Fragmented subtask: fold into the running maximum until the last fragment lands
+        int fragments = msg->hasPar("fragments") ? msg->par("fragments").longValue() : 1;
+        if (fragments > 1) {
+            auto key = make_tuple(clientId, taskId, subtaskId);
+            if (partialResults.find(key) == partialResults.end()) {
+                partialResultMemory->add(partialResultBytes());
+            }
+            PartialResult &partial = partialResults[key];
+            partial.max = (partial.received == 0) ? maxi : max(partial.max, maxi);
+            partial.received++;
+
+            if (partial.received < fragments) {
+                return nullptr;
+            }
+            maxi = partial.max;
+            partialResults.erase(key);
+            partialResultMemory->add(-partialResultBytes());
+        }
+
+        subtasksServed++;
+
+        // If malicious for this task, modify the result
+        if (!isHonest) {
+            maxi -= intuniform(1, 10); // Sabotage the result
+        }
+
+        // Create and send a ResultMessage back
+        cMessage *rm = pool.acquire("ResultMessage");
+
+        pool.addPar(rm, "taskId") = taskId;
+        pool.addPar(rm, "subtaskId") = subtaskId;
+        pool.addPar(rm, "result") = maxi;
+        pool.addPar(rm, "serverId") = getIndex();
+        if (msg->hasPar("stolenFrom")) {
+            // The client moves the subtask from the victim to this server
+            pool.addPar(rm, "stolenFrom") = msg->par("stolenFrom").longValue();
+        }
+
+        // Log sent result
+        logResult(taskId, subtaskId, clientId, maxi, isHonest);
+
+        if (msg->hasPar("aggregator")) {
+            // Aggregation tree mode: the leaf aggregator needs the routing info
+            const char *routing[] = {"aggregator", "clientId", "group", "fanIn", "dispatched", "replicas"};
+            for (const char *name : routing) {
+                pool.addPar(rm, name) = msg->par(name).longValue();
+            }
+        }
+        return rm;
+    }
+
+    // Map stage: count the values of the slice and queue one ShuffleMessage
+    // per partition and reduce server ("reducers" = 1,3,4;0,2,4 lists the
+    // servers of each partition), released with the batch's results
+    void shuffleMap(cMessage *msg, const int *first, const int *last) {
+        int taskId = msg->par("taskId").longValue();
+        int subtaskId = msg->par("subtaskId").longValue();
+        int clientId = clientGateOf(msg);
+        bool isHonest = !masterServer->isServerMalicious(clientId, taskId, getIndex());
+        masterServerMemory->replace(masterServerMemory->current, masterServer->getStateBytes());
+
+        vector<string> reducers;
+        istringstream partitionList(msg->par("reducers").stringValue());
+        string servers;
+        while (getline(partitionList, servers, ';')) {
+            reducers.push_back(servers);
+        }
+        int partitions = reducers.size();
+
+        vector<map<int, long>> counts(partitions);
+        for (const int *value = first; value < last; value++) {
+            counts[MapReduce::partitionOf(*value, partitions)][*value]++;
+        }
+
+        subtasksServed++;
+        for (int partition = 0; partition < partitions; partition++) {
+            if (!isHonest && !counts[partition].empty()) {
+                counts[partition].begin()->second += intuniform(1, 10); // Sabotage the counts
+            }
+            string payload = MapReduce::encodeCounts(counts[partition]);
+
+            istringstream serverList(reducers[partition]);
+            string reducer;
+            while (getline(serverList, reducer, ',')) {
+                cPacket *shuffle = pool.acquire("ShuffleMessage");
+                shuffle->setByteLength(SHUFFLE_HEADER_BYTES + payload.size());
+                pool.addPar(shuffle, "taskId") = taskId;
+                pool.addPar(shuffle, "clientId") = clientId;
+                pool.addPar(shuffle, "partition") = partition;
+                pool.addPar(shuffle, "mapSubtask") = subtaskId;
+                pool.addPar(shuffle, "mapSubtasks") = msg->par("mapSubtasks").longValue();
+                pool.addPar(shuffle, "replicas") = msg->par("replicas").longValue();
+                pool.addPar(shuffle, "serverId") = getIndex();
+                pool.addPar(shuffle, "data") = payload.c_str();
+                pool.addPar(shuffle, "shuffleTo") = stoi(reducer);
+
+                PendingResult pending = {shuffle, -1, msg->getArrivalTime()};
+                resultsInService.push_back(pending);
             }
+        }
+
+        LOG_DEBUG("Map Server:" + to_string(getIndex()) + " taskId:" + to_string(taskId) +
+                     " subtaskId:" + to_string(subtaskId) + " on gate:" + to_string(clientId) +
+                  " partitions:" + to_string(partitions) + " isHonest:" + (isHonest ? "true" : "false"));
+    }
 
+    // Reduce stage: sum the counts of every map subtask for one partition
+    cMessage *completeReduce(cMessage *msg, const int *first, const int *last) {
+        int taskId = msg->par("taskId").longValue();
+        int partition = msg->par("partition").longValue();
+        int clientId = clientGateOf(msg);
+        bool isHonest = !masterServer->isServerMalicious(clientId, taskId, getIndex());
+        masterServerMemory->replace(masterServerMemory->current, masterServer->getStateBytes());
+
+        map<int, long> counts;
+        for (const int *pair = first; pair + 1 < last; pair += 2) {
+            counts[pair[0]] += pair[1];
+        }
+        if (!isHonest && !counts.empty()) {
+            counts.begin()->second += intuniform(1, 10); // Sabotage the counts
+        }
+        subtasksServed++;
+        reducesRun++;
+
+        cMessage *rm = pool.acquire("ResultMessage");
+        pool.addPar(rm, "taskId") = taskId;
+        pool.addPar(rm, "partition") = partition;
+        pool.addPar(rm, "counts") = MapReduce::formatCounts(counts).c_str();
+        pool.addPar(rm, "mapScores") = msg->par("mapScores").stringValue();
+        pool.addPar(rm, "serverId") = getIndex();
+
+        LOG_DEBUG("Reduce Server:" + to_string(getIndex()) + " taskId:" + to_string(taskId) +
+                  " partition:" + to_string(partition) + " on gate:" + to_string(clientId) +
+                  " keys:" + to_string(counts.size()) + " isHonest:" + (isHonest ? "true" : "false"));
+        return rm;
+    }
+
+    // One ResultMessage for all subtasks of a coalesced bundle, with
+    // "results" = subtaskId1=result1,subtaskId2=result2,...
+    cMessage *completeBundle(cMessage *msg, const int *maxima, size_t count) {
+        int taskId = msg->par("taskId").longValue();
+        int clientId = clientGateOf(msg);
+
+        bool isHonest = !masterServer->isServerMalicious(clientId, taskId, getIndex());
+        masterServerMemory->replace(masterServerMemory->current, masterServer->getStateBytes());
+
+        istringstream subtaskIds(msg->par("subtaskIds").stringValue());
+        string token;
+        string results;
+        size_t i = 0;
+        while (getline(subtaskIds, token, ',')) {
+            if (i >= count) {
+                throw cRuntimeError("Bundle for task %d has more subtaskIds than payloads", taskId);
+            }
+            int subtaskId = stoi(token);
+            int maxi = maxima[i++];
+            if (!isHonest) {
+                maxi -= intuniform(1, 10); // Sabotage the result
+            }
+            subtasksServed++;
+            results += (results.empty() ? "" : ",") + token + "=" + to_string(maxi);
+            logResult(taskId, subtaskId, clientId, maxi, isHonest);
+        }
+        if (i != count) {
+            throw cRuntimeError("Bundle for task %d has fewer subtaskIds than payloads", taskId);
+        }
+        bundlesServed++;
+
+        cMessage *rm = pool.acquire("ResultMessage");
+        pool.addPar(rm, "taskId") = taskId;
+        pool.addPar(rm, "results") = results.c_str();
+        pool.addPar(rm, "serverId") = getIndex();
+        return rm;
+    }
+
+    void logResult(int taskId, int subtaskId, int clientId, int maxi, bool isHonest) {
+        LOG_DEBUG("Result Server:" + to_string(getIndex()) +
+            " taskId:" + to_string(taskId) +
+            " subtaskId:" + to_string(subtaskId) +
+            " on gate:" + to_string(clientId) +
+            " result:" + to_string(maxi) +
+            " isHonest:" + (isHonest ? "true" : "false"));
+    }
+
+    void logToFile(const string &message) {
+        PROFILE_SCOPE("Server::log");
+        ofstream out(OUTPUT, ios::app);
+        if (!out.is_open()) {
+            cout << "Error opening file " << OUTPUT << "\n";
+        } else {
+            out << message << "\n";
+            out.close();
+        }
+    }
+
+    void sendResult(PendingResult &pending) {
+        cHistogram &stats = pending.result->hasPar("shuffleTo") ? shuffleLatencyStats : serverLatencyStats;
+        stats.collect((simTime() - pending.arrival).dbl());
+        sendResult(pending.result, pending.gate);
+    }
+
+    void sendResult(cMessage *rm, int replyGate) {
+        if (rm->hasPar("shuffleTo")) {
+            // A map partition for one of its reduce servers
+            shuffleMessagesSent++;
+            shuffleBytesSent += static_cast<cPacket *>(rm)->getByteLength();
+            sendDirect(rm, getParentModule()->getSubmodule("server", rm->par("shuffleTo").longValue()), "shuffleIn");
+        } else if (rm->hasPar("aggregator")) {
+            int aggregatorId = rm->par("aggregator").longValue();
+            sendDirect(rm, getParentModule()->getSubmodule("aggregator", aggregatorId), "directIn");
+        } else {
             // Send back to the client that sent the request
-            send(rm, "out", msg->getArrivalGate()->getIndex());
+            sendToClient(rm, replyGate);
+        }
+    }
 
-            delete msg;
+    // Send on the link to a client once the replies queued before it are out;
+    // a batch can hold several results or fragments for the same client
+    void sendToClient(cMessage *rm, int replyGate) {
+        cChannel *channel = gate("out", replyGate)->findTransmissionChannel();
+        if (channel == nullptr) {
+            send(rm, "out", replyGate);
+            return;
+        }
+        simtime_t start = max(simTime(), max(channel->getTransmissionFinishTime(), linkFreeAt[replyGate]));
+        linkFreeAt[replyGate] = start + channel->calculateDuration(rm);
+        if (start > simTime()) {
+            sendDelayed(rm, start - simTime(), "out", replyGate);
         } else {
-            delete msg;
+            send(rm, "out", replyGate);
         }
     }
 
@@ -113,9 +1000,15 @@ protected:
         string str = "";
         if(strcmp(msg->getName(), "TaskMessage") == 0) {
             str += "TaskMessage: ";
-            str += "Server: " + to_string(getIndex()) + " on gate: " + to_string(msg->getArrivalGate()->getIndex()) + " ";
+            str += "Server: " + to_string(getIndex()) + " on gate: " + to_string(clientGateOf(msg)) + " ";
             str += "taskId: " + to_string(msg->par("taskId").longValue()) + " ";
-            str += "subtaskId: " + to_string(msg->par("subtaskId").longValue()) + " ";
+            if (msg->hasPar("subtaskIds")) {
+                str += "subtaskIds: " + string(msg->par("subtaskIds").stringValue()) + " ";
+            } else if (isStage(msg, "reduce")) {
+                str += "partition: " + to_string(msg->par("partition").longValue()) + " ";
+            } else {
+                str += "subtaskId: " + to_string(msg->par("subtaskId").longValue()) + " ";
+            }
             str += "data: " + string(msg->par("data").stringValue()) + "\n";
         }
         return str;
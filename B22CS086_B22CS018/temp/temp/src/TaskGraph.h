@@ -0,0 +1,124 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Dependencies between the subtasks of a task, given as edges "0>2,1>2,2>3":
+// subtask 2 takes the verified results of 0 and 1 as extra input, and 3 those
+// of 2. A subtask becomes ready once all its predecessors are decided. Ranks
+// give the longest remaining path from a subtask to the end of the task
+// (its own cost included), so the most critical ready subtask goes first.
+class TaskGraph {
+private:
+    int nodes;
+    std::vector<std::vector<int>> predecessors;
+    std::vector<std::vector<int>> successors;
+    std::vector<int> order; // topological
+
+public:
+    TaskGraph() : nodes(0) {}
+
+    // Throws on a malformed edge, a subtask outside [0, nodeCount) or a cycle
+    void parse(const std::string &edges, int nodeCount) {
+        nodes = nodeCount;
+        predecessors.assign(nodes, std::vector<int>());
+        successors.assign(nodes, std::vector<int>());
+
+        std::istringstream list(edges);
+        std::string token;
+        while (std::getline(list, token, ',')) {
+            size_t arrow = token.find('>');
+            if (arrow == std::string::npos) {
+                throw std::runtime_error("Bad task graph edge '" + token + "' (expected from>to)");
+            }
+            int from = std::stoi(token.substr(0, arrow));
+            int to = std::stoi(token.substr(arrow + 1));
+            if (from < 0 || from >= nodes || to < 0 || to >= nodes || from == to) {
+                throw std::runtime_error("Task graph edge '" + token + "' needs two distinct subtasks below " +
+                                         std::to_string(nodes));
+            }
+            predecessors[to].push_back(from);
+            successors[from].push_back(to);
+        }
+
+        // Kahn's algorithm; what is left over lies on a cycle
+        std::vector<int> waiting(nodes);
+        order.clear();
+        for (int node = 0; node < nodes; node++) {
+            waiting[node] = predecessors[node].size();
+            if (waiting[node] == 0) {
+                order.push_back(node);
+            }
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            for (int next : successors[order[i]]) {
+                if (--waiting[next] == 0) {
+                    order.push_back(next);
+                }
+            }
+        }
+        if ((int)order.size() != nodes) {
+            throw std::runtime_error("Task graph '" + edges + "' has a cycle");
+        }
+    }
+
+    bool isEmpty() const { return nodes == 0; }
+    int size() const { return nodes; }
+    const std::vector<int> &predecessorsOf(int node) const { return predecessors[node]; }
+    const std::vector<int> &successorsOf(int node) const { return successors[node]; }
+
+    // Longest path from each subtask to a sink, weighted by cost
+    std::vector<long> ranks(const std::vector<long> &cost) const {
+        std::vector<long> rank(nodes, 0);
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            long longest = 0;
+            for (int next : successors[*it]) {
+                longest = std::max(longest, rank[next]);
+            }
+            rank[*it] = cost[*it] + longest;
+        }
+        return rank;
+    }
+
+    // Subtasks on the longest path through the graph
+    int criticalPathNodes(const std::vector<long> &cost) const {
+        std::vector<long> rank = ranks(cost);
+        int node = -1;
+        for (int i = 0; i < nodes; i++) {
+            if (predecessors[i].empty() && (node < 0 || rank[i] > rank[node])) {
+                node = i;
+            }
+        }
+        int count = 0;
+        while (node >= 0) {
+            count++;
+            int next = -1;
+            for (int succ : successors[node]) {
+                if (next < 0 || rank[succ] > rank[next]) {
+                    next = succ;
+                }
+            }
+            node = next;
+        }
+        return count;
+    }
+
+    // Subtasks on the longest chain, counted in subtasks
+    int depth() const {
+        std::vector<int> level(nodes, 1);
+        int deepest = nodes > 0 ? 1 : 0;
+        for (int node : order) {
+            for (int next : successors[node]) {
+                level[next] = std::max(level[next], level[node] + 1);
+                deepest = std::max(deepest, level[next]);
+            }
+        }
+        return deepest;
+    }
+};
+
+#endif // TASKGRAPH_H
@@ -0,0 +1,142 @@
+#ifndef VOTETRACKER_H
+#define VOTETRACKER_H
+
+#include <vector>
+#include <utility>
+
+// Streaming majority vote over the replies for one subtask. Distinct result
+// values are counted in a fixed inline slot array, and the vote is decided as
+// soon as the leading value can no longer be overtaken by the replies still
+// outstanding (or once every reply is in, ties going to the value that reached
+// the top count first).
+class VoteTracker {
+public:
+    static const int SLOTS = 8;
+
+private:
+    int values[SLOTS];
+    int counts[SLOTS];
+    int usedSlots;
+
+    // Votes for values that found no free slot; they are all distinct from the
+    // slotted values and are treated as one opposing bloc
+    int otherVotes;
+
+    int expected;   // replies expected for this subtask
+    int received;   // replies counted so far
+    int leader;     // slot of the leading value, -1 while empty
+    bool decided;
+
+    // Replies seen before the decision, kept only so they can be scored once it
+    // is made: (serverId, slot), slot -1 meaning an unslotted value
+    std::pair<int, int> pendingInline[SLOTS];
+    int pendingCount;
+    std::vector<std::pair<int, int>> pendingOverflow;
+
+    void checkDecided() {
+        int runnerUp = otherVotes;
+        for (int i = 0; i < usedSlots; i++) {
+            if (i != leader && counts[i] > runnerUp) {
+                runnerUp = counts[i];
+            }
+        }
+        int remaining = expected - received;
+        if (leader >= 0 && (counts[leader] > runnerUp + remaining || remaining <= 0)) {
+            decided = true;
+        }
+    }
+
+public:
+    VoteTracker() {
+        reset(0);
+    }
+
+    void reset(int expectedReplies) {
+        usedSlots = 0;
+        otherVotes = 0;
+        expected = expectedReplies;
+        received = 0;
+        leader = -1;
+        decided = false;
+        pendingCount = 0;
+        pendingOverflow.clear();
+    }
+
+    // Decide the vote without replies (e.g. a cached or aggregated result)
+    void settle(int value) {
+        usedSlots = 1;
+        values[0] = value;
+        counts[0] = 0;
+        leader = 0;
+        decided = true;
+    }
+
+    // Another replica was dispatched for this subtask
+    void expectMore(int replies) {
+        expected += replies;
+    }
+
+    // Count one reply; returns true if this reply decided the vote
+    bool add(int serverId, int value) {
+        int slot = -1;
+        for (int i = 0; i < usedSlots; i++) {
+            if (values[i] == value) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0 && usedSlots < SLOTS) {
+            slot = usedSlots++;
+            values[slot] = value;
+            counts[slot] = 0;
+        }
+
+        received++;
+        if (slot >= 0) {
+            counts[slot]++;
+            if (leader < 0 || counts[slot] > counts[leader]) {
+                leader = slot;
+            }
+        } else {
+            otherVotes++;
+        }
+
+        if (decided) {
+            return false;
+        }
+
+        if (pendingCount < SLOTS) {
+            pendingInline[pendingCount++] = std::make_pair(serverId, slot);
+        } else {
+            pendingOverflow.push_back(std::make_pair(serverId, slot));
+        }
+
+        checkDecided();
+        return decided;
+    }
+
+    bool isDecided() const { return decided; }
+    int getMajority() const { return values[leader]; }
+    int getReceived() const { return received; }
+    int getExpected() const { return expected; }
+
+    // Replies received before the decision as (serverId, agreed with majority)
+    template <typename Visitor>
+    void forEachPendingReply(Visitor visit) const {
+        for (int i = 0; i < pendingCount; i++) {
+            visit(pendingInline[i].first, pendingInline[i].second == leader);
+        }
+        for (auto &p : pendingOverflow) {
+            visit(p.first, p.second == leader);
+        }
+    }
+
+    // Forget the pre-decision replies once they have been scored
+    void clearPending() {
+        pendingCount = 0;
+        pendingOverflow.clear();
+        pendingOverflow.shrink_to_fit();
+    }
+};
+
+#endif // VOTETRACKER_H
@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EventLoop.h"
+#include "../DatasetSource.h"
+#include "../ReputationTable.h"
+#include "../VoteTracker.h"
+
+using namespace std;
+
+// One Client of the model as a process and the load driver of the emulation.
+// It splits each task into subtasks, sends every subtask to a majority of the
+// servers (chosen at random for the first task and by reputation after it),
+// votes on the replies, scores the servers and gossips its counters to the
+// peer clients, exactly as Client does with messages.
+//
+// Tasks are offered closed loop (inFlight tasks outstanding at a time) or
+// open loop (--rate tasks per second). At the end it prints the measured
+// request rate and latency percentiles as scalars that can be set next to
+// the ones recorded by the simulation.
+//
+//   remoteexec-client --index 0 --clients 2 --servers unix:/tmp/rx/server0,unix:/tmp/rx/server1 ...
+class EmuClient
+{
+private:
+    struct Task {
+        int id;
+        double start;
+        vector<int> data;
+        vector<pair<int, int>> subtasks;  // (offset, length) into data
+        vector<VoteTracker> votes;        // one per subtask
+        vector<double> dispatched;        // send time per subtask
+        int decidedSubtasks;
+        int repliesOutstanding;
+        bool completed;
+        int result;
+    };
+
+    // Parameters
+    int index;
+    int numClients;
+    int numTasks;
+    int arraySize;
+    int numSubtasks;
+    int inFlight;
+    double rate;
+    double linger;
+    string reportFile;
+
+    EventLoop loop;
+    vector<int> serverFds;            // by serverId
+    unordered_map<int, int> serverOf; // fd -> serverId
+    vector<int> peerFds;
+
+    mt19937 rng;
+    StreamingDatasetSource dataset;
+    ReputationTable reputation;
+    unordered_map<int, Task> tasks;   // by taskId, until every reply is in
+
+    int tasksStarted;
+    int tasksCompleted;
+    bool finishing;
+    bool serverLost;
+
+    // Statistics
+    double firstStart;
+    double lastCompletion;
+    long subtaskRequests;
+    long resultsReceived;
+    long wrongResults;
+    long gossipSent;
+    long gossipReceived;
+    long gossipStale;
+    vector<double> taskLatencies;
+    vector<double> subtaskLatencies;
+
+public:
+    EmuClient(int index, int numClients, int numTasks, int arraySize, int numSubtasks,
+              int inFlight, double rate, double linger, unsigned seed, const string &reportFile)
+        : index(index), numClients(numClients), numTasks(numTasks), arraySize(arraySize),
+          numSubtasks(numSubtasks), inFlight(inFlight), rate(rate), linger(linger),
+          reportFile(reportFile), rng(seed * 1000003u + index), dataset(seed * 7919u + index, 1, 100),
+          tasksStarted(0), tasksCompleted(0), finishing(false), serverLost(false), firstStart(0), lastCompletion(0),
+          subtaskRequests(0), resultsReceived(0), wrongResults(0), gossipSent(0), gossipReceived(0),
+          gossipStale(0) {}
+
+    void run(const vector<string> &servers, const string &listenAddress, const vector<string> &peers) {
+        loop.onMessage([this](int fd, const WireMessage &msg) { handleMessage(fd, msg); });
+        loop.onClose([this](int fd) { handleClose(fd); });
+        loop.stopOnSignals();
+
+        // Listen before connecting, so peers started at the same time find each other
+        if (!listenAddress.empty()) {
+            loop.listen(listenAddress);
+        }
+
+        for (size_t serverId = 0; serverId < servers.size(); serverId++) {
+            int fd = loop.connect(servers[serverId], 5.0);
+            if (fd < 0) {
+                throw runtime_error("Cannot connect to server " + to_string(serverId) + " at " + servers[serverId]);
+            }
+            serverFds.push_back(fd);
+            serverOf[fd] = (int)serverId;
+
+            WireMessage hello("Hello");
+            hello.add("clientId", index);
+            loop.send(fd, hello);
+        }
+        reputation.configure((int)servers.size(), numClients, false);
+
+        // Gossip is best effort: a peer that cannot be reached is skipped
+        for (const string &peer : peers) {
+            int fd = loop.connect(peer, 5.0);
+            if (fd < 0) {
+                cerr << "Client " << index << " cannot reach peer " << peer << ", not gossiping to it\n";
+            }
+            peerFds.push_back(fd);
+        }
+
+        firstStart = EventLoop::now();
+        if (rate > 0) {
+            scheduleArrival();
+        } else {
+            for (int i = 0; i < inFlight && tasksStarted < numTasks; i++) {
+                startTask();
+            }
+        }
+
+        loop.run();
+        finish();
+    }
+
+    bool failed() const { return serverLost; }
+
+private:
+    void handleMessage(int fd, const WireMessage &msg) {
+        if (msg.name == "ResultMessage") {
+            handleResultMessage(msg);
+        } else if (msg.name == "GossipMessage") {
+            handleGossipMessage(msg);
+        } else {
+            cerr << "Client " << index << " ignoring unexpected " << msg.name << "\n";
+        }
+    }
+
+    void handleClose(int fd) {
+        auto it = serverOf.find(fd);
+        if (it != serverOf.end()) {
+            // Faults are the simulation's job; here a lost server ends the run
+            cerr << "Client " << index << " lost server " << it->second << "\n";
+            serverLost = true;
+            loop.stop();
+            return;
+        }
+        for (int &peerFd : peerFds) {
+            if (peerFd == fd) {
+                peerFd = -1;
+            }
+        }
+    }
+
+    void scheduleArrival() {
+        loop.after(1.0 / rate, [this]() {
+            if (tasksStarted < numTasks) {
+                startTask();
+                scheduleArrival();
+            }
+        });
+    }
+
+    void startTask() {
+        int taskId = ++tasksStarted;
+        Task &task = tasks[taskId];
+        task.id = taskId;
+        task.start = EventLoop::now();
+        const int *data = dataset.nextTask(taskId, arraySize);
+        task.data.assign(data, data + arraySize);
+        task.decidedSubtasks = 0;
+        task.repliesOutstanding = 0;
+        task.completed = false;
+        task.result = 0;
+
+        // Equal chunks of at least 2 elements, the last one takes the remainder
+        int subtaskCount = numSubtasks;
+        if (arraySize / subtaskCount < 2) {
+            subtaskCount = max(1, arraySize / 2);
+        }
+        int elementsPerSubtask = arraySize / subtaskCount;
+        for (int i = 0; i < subtaskCount; i++) {
+            int length = (i == subtaskCount - 1) ? arraySize - elementsPerSubtask * i : elementsPerSubtask;
+            task.subtasks.push_back({elementsPerSubtask * i, length});
+        }
+        task.votes.resize(subtaskCount);
+        task.dispatched.resize(subtaskCount);
+
+        // A majority of the servers per subtask, as in Client::selectServers
+        int numServers = (int)serverFds.size();
+        int serversPerSubtask = numServers / 2 + 1;
+        vector<int> topServers;
+        if (tasksCompleted > 0) {
+            topServers = reputation.topServers(serversPerSubtask);
+        }
+
+        for (int subtaskId = 0; subtaskId < subtaskCount; subtaskId++) {
+            vector<int> selectedServers = topServers;
+            if (tasksCompleted == 0) {
+                vector<int> allServers;
+                for (int i = 0; i < numServers; i++) {
+                    allServers.push_back(i);
+                }
+                shuffle(allServers.begin(), allServers.end(), rng);
+                selectedServers.assign(allServers.begin(), allServers.begin() + serversPerSubtask);
+            }
+            sendSubtask(task, subtaskId, selectedServers);
+        }
+    }
+
+    void sendSubtask(Task &task, int subtaskId, const vector<int> &servers) {
+        const pair<int, int> &subtask = task.subtasks[subtaskId];
+        string payload;
+        for (int i = subtask.first; i < subtask.first + subtask.second; i++) {
+            payload += to_string(task.data[i]);
+            payload += ' ';
+        }
+
+        WireMessage msg("TaskMessage");
+        msg.add("taskId", task.id);
+        msg.add("subtaskId", subtaskId);
+        msg.add("data", payload);
+
+        int sent = 0;
+        for (int serverId : servers) {
+            loop.send(serverFds[serverId], msg);
+            reputation.addTaskSubtask(serverId);
+            sent++;
+        }
+        task.votes[subtaskId].reset(sent);
+        task.dispatched[subtaskId] = EventLoop::now();
+        task.repliesOutstanding += sent;
+        subtaskRequests += sent;
+    }
+
+    void handleResultMessage(const WireMessage &msg) {
+        resultsReceived++;
+        int taskId = (int)msg.longValue("taskId");
+        int subtaskId = (int)msg.longValue("subtaskId");
+        int result = (int)msg.longValue("result");
+        int serverId = (int)msg.longValue("serverId");
+
+        auto it = tasks.find(taskId);
+        if (it == tasks.end()) {
+            return;
+        }
+        Task &task = it->second;
+        VoteTracker &vote = task.votes[subtaskId];
+        task.repliesOutstanding--;
+
+        if (vote.isDecided()) {
+            // Late reply, scored directly like Client::scoreLateReply
+            if (result == vote.getMajority()) {
+                reputation.addTaskScore(serverId, 1);
+            }
+        } else if (vote.add(serverId, result)) {
+            subtaskLatencies.push_back(EventLoop::now() - task.dispatched[subtaskId]);
+            vote.forEachPendingReply([&](int serverId, bool agreed) {
+                if (agreed) {
+                    reputation.addTaskScore(serverId, 1);
+                }
+            });
+            vote.clearPending();
+
+            int majority = vote.getMajority();
+            task.result = (task.decidedSubtasks == 0) ? majority : max(task.result, majority);
+            if (++task.decidedSubtasks == (int)task.subtasks.size()) {
+                completeTask(task);
+            }
+        }
+
+        // completeTask may have started another task, so erase by key
+        if (task.completed && task.repliesOutstanding == 0) {
+            tasks.erase(taskId);
+            checkDone();
+        }
+    }
+
+    void completeTask(Task &task) {
+        double now = EventLoop::now();
+        task.completed = true;
+        taskLatencies.push_back(now - task.start);
+        lastCompletion = now;
+        tasksCompleted++;
+
+        if (task.result != *max_element(task.data.begin(), task.data.end())) {
+            wrongResults++;
+        }
+
+        broadcastScores(task.id);
+
+        if (rate <= 0 && tasksStarted < numTasks) {
+            startTask();
+        }
+    }
+
+    // Fold the scores so far into our own counters and gossip all of them,
+    // in the format of Client::broadcastScores
+    void broadcastScores(int taskNumber) {
+        reputation.commitTask(index);
+        reputation.resetTask();
+
+        string scoreStr = to_string(index) + ":";
+        bool first = true;
+        for (int row = 0; row < reputation.rows(); row++) {
+            if (reputation.getOriginCount(index, row) == 0) {
+                continue;
+            }
+            if (!first) {
+                scoreStr += ",";
+            }
+            first = false;
+            scoreStr += to_string(reputation.serverAt(row)) + "=" + to_string(reputation.getOriginScore(index, row)) +
+                        ":" + to_string(reputation.getOriginCount(index, row));
+        }
+
+        WireMessage gossip("GossipMessage");
+        gossip.add("timestamp", EventLoop::now() - firstStart);
+        gossip.add("score", scoreStr);
+        gossip.add("taskNumber", taskNumber);
+        sendGossip(gossip);
+    }
+
+    void sendGossip(const WireMessage &gossip) {
+        for (int fd : peerFds) {
+            if (fd >= 0) {
+                loop.send(fd, gossip);
+                gossipSent++;
+            }
+        }
+    }
+
+    void handleGossipMessage(const WireMessage &msg) {
+        gossipReceived++;
+        if (processReceivedScores(msg.stringValue("score"))) {
+            // New to us, so possibly to our peers as well
+            sendGossip(msg);
+        } else {
+            gossipStale++;
+        }
+    }
+
+    // Merge an origin's cumulative counters; false if none of them was new
+    bool processReceivedScores(const string &scoreStr) {
+        size_t colonPos = scoreStr.find(':');
+        if (colonPos == string::npos) return false;
+
+        int clientId = stoi(scoreStr.substr(0, colonPos));
+        if (clientId < 0 || clientId >= numClients) return false;
+
+        istringstream ss(scoreStr.substr(colonPos + 1));
+        string token;
+        bool changed = false;
+        while (getline(ss, token, ',')) {
+            size_t equalsPos = token.find('=');
+            size_t countPos = token.find(':', equalsPos);
+            if (equalsPos == string::npos || countPos == string::npos) continue;
+
+            int serverId = stoi(token.substr(0, equalsPos));
+            int score = stoi(token.substr(equalsPos + 1, countPos - equalsPos - 1));
+            int subtaskCount = stoi(token.substr(countPos + 1));
+            if (serverId < 0 || serverId >= (int)serverFds.size()) continue;
+
+            if (reputation.mergeOrigin(clientId, serverId, score, subtaskCount)) {
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Stop once every task is done and every reply is in, then keep taking
+    // gossip for a little while so the peers' last rounds are merged
+    void checkDone() {
+        if (finishing || tasksCompleted < numTasks || !tasks.empty()) {
+            return;
+        }
+        finishing = true;
+        loop.after(linger, [this]() { loop.stop(); });
+    }
+
+    static double percentile(vector<double> values, double p) {
+        if (values.empty()) {
+            return 0;
+        }
+        sort(values.begin(), values.end());
+        size_t rank = (size_t)ceil(p * values.size());
+        return values[rank > 0 ? rank - 1 : 0];
+    }
+
+    static double mean(const vector<double> &values) {
+        double sum = 0;
+        for (double value : values) {
+            sum += value;
+        }
+        return values.empty() ? 0 : sum / values.size();
+    }
+
+    void finish() {
+        double elapsed = lastCompletion - firstStart;
+        string module = "emulation.client[" + to_string(index) + "]";
+        vector<pair<string, double>> scalars = {
+            {"tasksCompleted", (double)tasksCompleted},
+            {"wrongResults", (double)wrongResults},
+            {"subtaskRequests", (double)subtaskRequests},
+            {"resultsReceived", (double)resultsReceived},
+            {"elapsedSeconds", elapsed},
+            {"tasksPerSecond", elapsed > 0 ? tasksCompleted / elapsed : 0.0},
+            {"requestsPerSecond", elapsed > 0 ? resultsReceived / elapsed : 0.0},
+            {"taskLatencyMean", mean(taskLatencies)},
+            {"taskLatencyP50", percentile(taskLatencies, 0.50)},
+            {"taskLatencyP95", percentile(taskLatencies, 0.95)},
+            {"taskLatencyP99", percentile(taskLatencies, 0.99)},
+            {"subtaskLatencyMean", mean(subtaskLatencies)},
+            {"subtaskLatencyP50", percentile(subtaskLatencies, 0.50)},
+            {"subtaskLatencyP95", percentile(subtaskLatencies, 0.95)},
+            {"subtaskLatencyP99", percentile(subtaskLatencies, 0.99)},
+            {"gossipSent", (double)gossipSent},
+            {"gossipReceived", (double)gossipReceived},
+            {"gossipStale", (double)gossipStale},
+            {"reputationSpread", reputation.avgScoreSpread()},
+        };
+
+        stringstream out;
+        for (auto &scalar : scalars) {
+            out << "scalar " << module << " " << scalar.first << " " << scalar.second << "\n";
+        }
+        cout << out.str();
+        cout.flush();
+
+        if (!reportFile.empty()) {
+            ofstream report(reportFile, ios::trunc);
+            if (!report.is_open()) {
+                cerr << "Error opening file " << reportFile << "\n";
+                return;
+            }
+            report << out.str();
+        }
+    }
+};
+
+static vector<string> splitList(const string &list) {
+    vector<string> items;
+    istringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static void usage() {
+    cerr << "usage: remoteexec-client --servers ADDRESS,... [--index N] [--clients N]\n"
+            "                         [--tasks N] [--array-size N] [--subtasks N]\n"
+            "                         [--in-flight N | --rate TASKS_PER_SECOND]\n"
+            "                         [--listen ADDRESS] [--peers ADDRESS,...] [--linger SECONDS]\n"
+            "                         [--seed N] [--report FILE]\n"
+            "  ADDRESS is tcp:port, tcp:host:port or unix:path; server i is the i-th address\n";
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    vector<string> servers;
+    vector<string> peers;
+    string listenAddress;
+    string reportFile;
+    int index = 0;
+    int numClients = 1;
+    int numTasks = 100;
+    int arraySize = 99;
+    int numSubtasks = 3;
+    int inFlight = 1;
+    double rate = 0;
+    double linger = 0.2;
+    unsigned seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        string value = argv[i + 1];
+        if (arg == "--servers") {
+            servers = splitList(value);
+        } else if (arg == "--peers") {
+            peers = splitList(value);
+        } else if (arg == "--listen") {
+            listenAddress = value;
+        } else if (arg == "--report") {
+            reportFile = value;
+        } else if (arg == "--index") {
+            index = stoi(value);
+        } else if (arg == "--clients") {
+            numClients = stoi(value);
+        } else if (arg == "--tasks") {
+            numTasks = stoi(value);
+        } else if (arg == "--array-size") {
+            arraySize = stoi(value);
+        } else if (arg == "--subtasks") {
+            numSubtasks = stoi(value);
+        } else if (arg == "--in-flight") {
+            inFlight = stoi(value);
+        } else if (arg == "--rate") {
+            rate = stod(value);
+        } else if (arg == "--linger") {
+            linger = stod(value);
+        } else if (arg == "--seed") {
+            seed = (unsigned)stoul(value);
+        } else {
+            usage();
+        }
+    }
+    if (argc % 2 == 0 || servers.empty() || index < 0 || index >= numClients ||
+        numTasks < 1 || arraySize < 1 || numSubtasks < 1 || inFlight < 1) {
+        usage();
+    }
+
+    try {
+        EmuClient client(index, numClients, numTasks, arraySize, numSubtasks, inFlight, rate, linger, seed, reportFile);
+        client.run(servers, listenAddress, peers);
+        if (client.failed()) {
+            return 1;
+        }
+    } catch (const exception &e) {
+        cerr << "Client " << index << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
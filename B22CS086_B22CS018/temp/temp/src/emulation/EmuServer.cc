@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include "EventLoop.h"
+#include "../MasterServer.h"
+
+using namespace std;
+
+// One Server of the model as a process: accepts client connections, computes
+// the maximum of each TaskMessage and answers with a ResultMessage, sabotaged
+// like the simulated server when MasterServer marks it malicious for the task.
+// Subtasks are served one at a time in arrival order, like the model's
+// single-queue server. On SIGINT/SIGTERM it prints its scalars and exits.
+//
+//   remoteexec-server --listen unix:/tmp/rx/server0 --index 0 --servers 4
+class EmuServer
+{
+private:
+    int index;
+    bool honest;
+    double serviceTimePerElement;
+
+    EventLoop loop;
+    MasterServer *masterServer;
+    mt19937 rng;
+    unordered_map<int, int> clientOf; // fd -> clientId from its Hello
+
+    long subtasksServed;
+    long maliciousResults;
+    double busySeconds;
+    double started;
+
+public:
+    EmuServer(int index, int numServers, unsigned seed, bool honest, double serviceTimePerElement)
+        : index(index), honest(honest), serviceTimePerElement(serviceTimePerElement),
+          rng(seed + index), subtasksServed(0), maliciousResults(0), busySeconds(0), started(0) {
+        masterServer = MasterServer::getInstance();
+        masterServer->setTotalServers(numServers);
+        masterServer->setSharedSeed(seed);
+
+        // MasterServer needs at least 4 servers to pick a malicious one
+        if (numServers < 4) {
+            this->honest = true;
+        }
+    }
+
+    void run(const string &address) {
+        loop.listen(address);
+        loop.stopOnSignals();
+        loop.onMessage([this](int fd, const WireMessage &msg) { handleMessage(fd, msg); });
+        loop.onClose([this](int fd) { clientOf.erase(fd); });
+
+        started = EventLoop::now();
+        loop.run();
+        finish();
+    }
+
+private:
+    void handleMessage(int fd, const WireMessage &msg) {
+        if (msg.name == "Hello") {
+            clientOf[fd] = (int)msg.longValue("clientId");
+        } else if (msg.name == "TaskMessage") {
+            handleTaskMessage(fd, msg);
+        } else {
+            cerr << "Server " << index << " ignoring unexpected " << msg.name << "\n";
+        }
+    }
+
+    void handleTaskMessage(int fd, const WireMessage &msg) {
+        auto client = clientOf.find(fd);
+        if (client == clientOf.end()) {
+            cerr << "Server " << index << " got a task before Hello, closing the connection\n";
+            loop.close(fd);
+            return;
+        }
+        int clientId = client->second;
+        long taskId = msg.longValue("taskId");
+        long subtaskId = msg.longValue("subtaskId");
+
+        double begin = EventLoop::now();
+
+        // Same parse and kernel as Server::runBatch
+        const char *data = msg.stringValue("data").c_str();
+        char *end;
+        long elements = 0;
+        int maxi = 0;
+        for (long value = strtol(data, &end, 10); end != data; value = strtol(data, &end, 10)) {
+            maxi = (elements == 0) ? (int)value : max(maxi, (int)value);
+            elements++;
+            data = end;
+        }
+
+        // Stand in for the modelled service time, if given
+        double serviceEnd = begin + elements * serviceTimePerElement;
+        while (EventLoop::now() < serviceEnd) {
+        }
+
+        if (!honest && masterServer->isServerMalicious(clientId, (int)taskId, index)) {
+            maxi -= uniform_int_distribution<int>(1, 10)(rng); // Sabotage the result
+            maliciousResults++;
+        }
+        subtasksServed++;
+        busySeconds += EventLoop::now() - begin;
+
+        WireMessage rm("ResultMessage");
+        rm.add("taskId", taskId);
+        rm.add("subtaskId", subtaskId);
+        rm.add("result", maxi);
+        rm.add("serverId", index);
+        loop.send(fd, rm);
+    }
+
+    void finish() {
+        double elapsed = EventLoop::now() - started;
+        string module = "emulation.server[" + to_string(index) + "]";
+        cout << "scalar " << module << " subtasksServed " << subtasksServed << "\n";
+        cout << "scalar " << module << " maliciousResults " << maliciousResults << "\n";
+        cout << "scalar " << module << " busySeconds " << busySeconds << "\n";
+        cout << "scalar " << module << " utilization " << (elapsed > 0 ? busySeconds / elapsed : 0.0) << "\n";
+        cout.flush();
+    }
+};
+
+static void usage() {
+    cerr << "usage: remoteexec-server --listen ADDRESS [--index N] [--servers N] [--seed N]\n"
+            "                         [--honest] [--service-time SECONDS_PER_ELEMENT]\n"
+            "  ADDRESS is tcp:port, tcp:host:port or unix:path\n";
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    string address;
+    int index = 0;
+    int numServers = 1;
+    unsigned seed = 1;
+    bool honest = false;
+    double serviceTime = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--honest") {
+            honest = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage();
+        }
+        string value = argv[++i];
+        if (arg == "--listen") {
+            address = value;
+        } else if (arg == "--index") {
+            index = stoi(value);
+        } else if (arg == "--servers") {
+            numServers = stoi(value);
+        } else if (arg == "--seed") {
+            seed = (unsigned)stoul(value);
+        } else if (arg == "--service-time") {
+            serviceTime = stod(value);
+        } else {
+            usage();
+        }
+    }
+    if (address.empty()) {
+        usage();
+    }
+
+    try {
+        EmuServer server(index, numServers, seed, honest, serviceTime);
+        server.run(address);
+    } catch (const exception &e) {
+        cerr << "Server " << index << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,379 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "WireProtocol.h"
+
+// Single-threaded epoll loop over framed connections, for the emulation
+// processes. Addresses are "tcp:port" or "tcp:host:port" (loopback by
+// default) and "unix:path". Sockets are non-blocking and level triggered;
+// output that does not fit in the socket is buffered and flushed on EPOLLOUT.
+// A broken connection is closed and reported through onClose.
+class EventLoop {
+public:
+    typedef std::function<void(int fd, const WireMessage &msg)> MessageHandler;
+    typedef std::function<void(int fd)> ConnectionHandler;
+
+private:
+    struct Connection {
+        bool listener;
+        bool writeWatched;
+        FrameReader reader;
+        std::string out;
+        size_t outPos;
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+
+        Connection() : listener(false), writeWatched(false), outPos(0), bytesIn(0), bytesOut(0) {}
+    };
+
+    int epollFd;
+    std::unordered_map<int, Connection> connections;
+    std::multimap<double, std::function<void()>> timers;
+    bool stopped;
+
+    MessageHandler messageHandler;
+    ConnectionHandler acceptHandler;
+    ConnectionHandler closeHandler;
+
+    static volatile sig_atomic_t &signalled() {
+        static volatile sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    static void onSignal(int) {
+        signalled() = 1;
+    }
+
+    static void setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    // Fills in a sockaddr for the address; returns its length and the family
+    static socklen_t parseAddress(const std::string &address, sockaddr_storage &storage, int &family) {
+        std::memset(&storage, 0, sizeof(storage));
+        if (address.compare(0, 5, "unix:") == 0) {
+            std::string path = address.substr(5);
+            sockaddr_un *un = (sockaddr_un *)&storage;
+            if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+                throw std::runtime_error("Bad unix socket path in " + address);
+            }
+            un->sun_family = AF_UNIX;
+            std::strcpy(un->sun_path, path.c_str());
+            family = AF_UNIX;
+            return sizeof(sockaddr_un);
+        }
+        if (address.compare(0, 4, "tcp:") == 0) {
+            std::string rest = address.substr(4);
+            std::string host = "127.0.0.1";
+            size_t colon = rest.rfind(':');
+            if (colon != std::string::npos) {
+                host = rest.substr(0, colon);
+                rest = rest.substr(colon + 1);
+            }
+            sockaddr_in *in = (sockaddr_in *)&storage;
+            in->sin_family = AF_INET;
+            in->sin_port = htons((uint16_t)std::stoi(rest));
+            if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) {
+                throw std::runtime_error("Bad IPv4 address in " + address);
+            }
+            family = AF_INET;
+            return sizeof(sockaddr_in);
+        }
+        throw std::runtime_error("Unknown address '" + address + "' (expected tcp:port or unix:path)");
+    }
+
+    void watch(int fd, bool listener) {
+        setNonBlocking(fd);
+        connections[fd].listener = listener;
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            throw std::runtime_error(std::string("epoll_ctl: ") + std::strerror(errno));
+        }
+    }
+
+    void setWriteInterest(int fd, Connection &connection, bool enabled) {
+        if (connection.writeWatched == enabled) {
+            return;
+        }
+        connection.writeWatched = enabled;
+        epoll_event event = {};
+        event.events = enabled ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    void acceptAll(int listenFd) {
+        for (;;) {
+            int fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                return; // EAGAIN, or a connection that went away
+            }
+            setNoDelay(fd);
+            watch(fd, false);
+            if (acceptHandler) {
+                acceptHandler(fd);
+            }
+        }
+    }
+
+    void readAll(int fd) {
+        char chunk[65536];
+        for (;;) {
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                close(fd);
+                return;
+            }
+            if (n < 0) {
+                break;
+            }
+            Connection &connection = connections[fd];
+            connection.bytesIn += n;
+            connection.reader.append(chunk, n);
+        }
+
+        WireMessage msg;
+        for (;;) {
+            // A handler may close this connection
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                return;
+            }
+            try {
+                if (!it->second.reader.next(msg)) {
+                    return;
+                }
+            } catch (const std::exception &) {
+                close(fd); // A peer speaking something else
+                return;
+            }
+            if (messageHandler) {
+                messageHandler(fd, msg);
+            }
+        }
+    }
+
+    void flush(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection &connection = it->second;
+        while (connection.outPos < connection.out.size()) {
+            ssize_t n = ::send(fd, connection.out.data() + connection.outPos,
+                               connection.out.size() - connection.outPos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    setWriteInterest(fd, connection, true);
+                    return;
+                }
+                close(fd);
+                return;
+            }
+            connection.outPos += n;
+            connection.bytesOut += n;
+        }
+        connection.out.clear();
+        connection.outPos = 0;
+        setWriteInterest(fd, connection, false);
+    }
+
+    static void setNoDelay(int fd) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on unix sockets
+    }
+
+public:
+    EventLoop() : stopped(false) {
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) {
+            throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(errno));
+        }
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+
+    ~EventLoop() {
+        while (!connections.empty()) {
+            int fd = connections.begin()->first;
+            connections.erase(connections.begin());
+            ::close(fd);
+        }
+        ::close(epollFd);
+    }
+
+    // Seconds on a monotonic clock
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void onMessage(MessageHandler handler) { messageHandler = handler; }
+    void onAccept(ConnectionHandler handler) { acceptHandler = handler; }
+    void onClose(ConnectionHandler handler) { closeHandler = handler; }
+
+    // Leave run() on SIGINT or SIGTERM
+    void stopOnSignals() {
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+    }
+
+    int listen(const std::string &address) {
+        sockaddr_storage storage;
+        int family;
+        socklen_t length = parseAddress(address, storage, family);
+        int fd = ::socket(family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        if (family == AF_UNIX) {
+            ::unlink(((sockaddr_un *)&storage)->sun_path);
+        } else {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (::bind(fd, (sockaddr *)&storage, length) < 0 || ::listen(fd, 128) < 0) {
+            std::string error = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error("Cannot listen on " + address + ": " + error);
+        }
+        watch(fd, true);
+        return fd;
+    }
+
+    // Blocking connect, then the socket joins the loop; -1 if nobody listens
+    int connect(const std::string &address) {
+        sockaddr_storage storage;
+        int family;
+        socklen_t length = parseAddress(address, storage, family);
+        int fd = ::socket(family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        if (::connect(fd, (sockaddr *)&storage, length) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        setNoDelay(fd);
+        watch(fd, false);
+        return fd;
+    }
+
+    // Retry connect until it succeeds or timeout seconds have passed
+    int connect(const std::string &address, double timeout) {
+        double deadline = now() + timeout;
+        for (;;) {
+            int fd = connect(address);
+            if (fd >= 0 || now() >= deadline) {
+                return fd;
+            }
+            usleep(20000);
+        }
+    }
+
+    void send(int fd, const WireMessage &msg) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) {
+            return; // Already closed
+        }
+        bool idle = it->second.out.empty();
+        it->second.out += encodeFrame(msg);
+        if (idle) {
+            flush(fd);
+        }
+    }
+
+    void close(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
+        }
+        bool listener = it->second.listener;
+        connections.erase(it);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        if (!listener && closeHandler) {
+            closeHandler(fd);
+        }
+    }
+
+    bool isOpen(int fd) const { return connections.count(fd) > 0; }
+
+    uint64_t bytesIn(int fd) const {
+        auto it = connections.find(fd);
+        return it == connections.end() ? 0 : it->second.bytesIn;
+    }
+
+    uint64_t bytesOut(int fd) const {
+        auto it = connections.find(fd);
+        return it == connections.end() ? 0 : it->second.bytesOut;
+    }
+
+    // Call fn once, delay seconds from now
+    void after(double delay, std::function<void()> fn) {
+        timers.insert({now() + delay, fn});
+    }
+
+    void stop() { stopped = true; }
+
+    // Dispatch until stop() or a signal registered with stopOnSignals
+    void run() {
+        epoll_event events[64];
+        while (!stopped && !signalled()) {
+            int timeout = -1;
+            if (!timers.empty()) {
+                double wait = timers.begin()->first - now();
+                timeout = wait <= 0 ? 0 : (int)(wait * 1000) + 1;
+            }
+
+            int n = epoll_wait(epollFd, events, 64, timeout);
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    continue;
+                }
+                if (it->second.listener) {
+                    acceptAll(fd);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(fd);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readAll(fd);
+                }
+            }
+
+            double current = now();
+            while (!stopped && !timers.empty() && timers.begin()->first <= current) {
+                std::function<void()> fn = timers.begin()->second;
+                timers.erase(timers.begin());
+                fn();
+            }
+        }
+    }
+};
+
+#endif // EVENTLOOP_H
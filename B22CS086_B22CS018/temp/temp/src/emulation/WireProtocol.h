@@ -0,0 +1,165 @@
+#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The simulation's messages on a byte stream. A frame is a 4-byte big-endian
+// payload length followed by the message name and its parameters, separated
+// by tabs:
+//
+//   TaskMessage\ttaskId=3\tsubtaskId=1\tdata=17 4 92 ...
+//   ResultMessage\ttaskId=3\tsubtaskId=1\tresult=92\tserverId=4
+//   GossipMessage\ttimestamp=1.25\tscore=0:4=3:3,7=2:3\ttaskNumber=3
+//
+// Names and parameters are the ones the modules put on their cMessages, so a
+// frame carries exactly what a message does in the model. A connection opens
+// with a Hello frame (clientId) in place of the gate a message arrives on.
+// Values may not contain tabs.
+
+static const uint32_t WIRE_MAX_FRAME = 64 * 1024 * 1024;
+
+struct WireMessage {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> pars;
+
+    WireMessage() {}
+    explicit WireMessage(const std::string &name) : name(name) {}
+
+    WireMessage &add(const std::string &key, const std::string &value) {
+        pars.push_back({key, value});
+        return *this;
+    }
+
+    WireMessage &add(const std::string &key, int value) {
+        return add(key, std::to_string(value));
+    }
+
+    WireMessage &add(const std::string &key, long value) {
+        return add(key, std::to_string(value));
+    }
+
+    WireMessage &add(const std::string &key, double value) {
+        return add(key, std::to_string(value));
+    }
+
+    bool hasPar(const std::string &key) const {
+        return findPar(key) != nullptr;
+    }
+
+    const std::string &stringValue(const std::string &key) const {
+        const std::string *value = findPar(key);
+        if (value == nullptr) {
+            throw std::runtime_error(name + " has no parameter " + key);
+        }
+        return *value;
+    }
+
+    long longValue(const std::string &key) const {
+        return std::strtol(stringValue(key).c_str(), nullptr, 10);
+    }
+
+    double doubleValue(const std::string &key) const {
+        return std::strtod(stringValue(key).c_str(), nullptr);
+    }
+
+private:
+    const std::string *findPar(const std::string &key) const {
+        for (auto &par : pars) {
+            if (par.first == key) {
+                return &par.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+inline std::string encodeFrame(const WireMessage &msg) {
+    std::string payload = msg.name;
+    for (auto &par : msg.pars) {
+        payload += '\t';
+        payload += par.first;
+        payload += '=';
+        payload += par.second;
+    }
+
+    uint32_t length = (uint32_t)payload.size();
+    std::string frame(4, '\0');
+    for (int i = 0; i < 4; i++) {
+        frame[i] = (char)((length >> (24 - 8 * i)) & 0xff);
+    }
+    return frame + payload;
+}
+
+inline WireMessage decodePayload(const char *data, size_t length) {
+    WireMessage msg;
+    size_t start = 0;
+    bool first = true;
+    while (start <= length) {
+        size_t end = start;
+        while (end < length && data[end] != '\t') {
+            end++;
+        }
+        std::string token(data + start, end - start);
+        if (first) {
+            msg.name = token;
+            first = false;
+        } else {
+            size_t equals = token.find('=');
+            if (equals == std::string::npos) {
+                throw std::runtime_error("Malformed parameter '" + token + "' in " + msg.name);
+            }
+            msg.pars.push_back({token.substr(0, equals), token.substr(equals + 1)});
+        }
+        start = end + 1;
+    }
+    return msg;
+}
+
+// Reassembles frames from the chunks read off a socket
+class FrameReader {
+private:
+    std::string buffer;
+    size_t pos;
+
+public:
+    FrameReader() : pos(0) {}
+
+    void append(const char *data, size_t length) {
+        // Drop what has been consumed before growing the buffer
+        if (pos > 0 && pos == buffer.size()) {
+            buffer.clear();
+            pos = 0;
+        } else if (pos > buffer.size() / 2) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        buffer.append(data, length);
+    }
+
+    // Next complete frame, false if it has not fully arrived yet
+    bool next(WireMessage &msg) {
+        if (buffer.size() - pos < 4) {
+            return false;
+        }
+        uint32_t length = 0;
+        for (int i = 0; i < 4; i++) {
+            length = (length << 8) | (uint8_t)buffer[pos + i];
+        }
+        if (length > WIRE_MAX_FRAME) {
+            throw std::runtime_error("Frame of " + std::to_string(length) + " bytes is too large");
+        }
+        if (buffer.size() - pos - 4 < length) {
+            return false;
+        }
+        msg = decodePayload(buffer.data() + pos + 4, length);
+        pos += 4 + length;
+        return true;
+    }
+};
+
+#endif // WIREPROTOCOL_H
@@ -0,0 +1,125 @@
+import argparse
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+
+def run_emulation(args):
+    """
+    Start the servers and clients of one emulation run as local processes,
+    wait for the clients to finish their tasks, stop the servers and return
+    every "scalar <module> <name> <value>" line they printed.
+
+    The clients gossip over a full mesh, like the gout/gin connections of
+    RemoteExecNetwork.
+    """
+    workdir = tempfile.mkdtemp(prefix="remoteexec-")
+    bindir = os.path.dirname(os.path.abspath(__file__))
+
+    def address(kind, index):
+        if args.transport == "unix":
+            return f"unix:{os.path.join(workdir, f'{kind}{index}.sock')}"
+        base = args.base_port + (0 if kind == "server" else args.servers)
+        return f"tcp:{base + index}"
+
+    servers = [address("server", i) for i in range(args.servers)]
+    clients = [address("client", i) for i in range(args.clients)]
+
+    server_procs = []
+    client_procs = []
+    try:
+        for i, addr in enumerate(servers):
+            cmd = [os.path.join(bindir, "remoteexec-server"), "--listen", addr, "--index", str(i),
+                   "--servers", str(args.servers), "--seed", str(args.seed),
+                   "--service-time", str(args.service_time)]
+            if args.honest:
+                cmd.append("--honest")
+            server_procs.append(subprocess.Popen(cmd, stdout=subprocess.PIPE, text=True))
+
+        for i, addr in enumerate(clients):
+            peers = [peer for j, peer in enumerate(clients) if j != i]
+            cmd = [os.path.join(bindir, "remoteexec-client"), "--index", str(i), "--clients", str(args.clients),
+                   "--servers", ",".join(servers), "--listen", addr, "--tasks", str(args.tasks),
+                   "--array-size", str(args.array_size), "--subtasks", str(args.subtasks),
+                   "--seed", str(args.seed)]
+            if peers:
+                cmd += ["--peers", ",".join(peers)]
+            if args.rate > 0:
+                cmd += ["--rate", str(args.rate)]
+            else:
+                cmd += ["--in-flight", str(args.in_flight)]
+            client_procs.append(subprocess.Popen(cmd, stdout=subprocess.PIPE, text=True))
+
+        lines = []
+        failed = False
+        for proc in client_procs:
+            out, _ = proc.communicate()
+            lines += out.splitlines()
+            failed = failed or proc.returncode != 0
+    finally:
+        for proc in server_procs:
+            proc.send_signal(signal.SIGTERM)
+        for proc in client_procs:
+            if proc.poll() is None:
+                proc.kill()
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    for proc in server_procs:
+        out, _ = proc.communicate()
+        lines += out.splitlines()
+    return [line for line in lines if line.startswith("scalar ")], failed
+
+def summarize(scalars):
+    """Sum the request rates and average the latency percentiles over the clients."""
+    values = {}
+    for line in scalars:
+        _, module, name, value = line.split()
+        if module.startswith("emulation.client"):
+            values.setdefault(name, []).append(float(value))
+
+    summary = []
+    for name in ["tasksPerSecond", "requestsPerSecond", "wrongResults"]:
+        if name in values:
+            summary.append((name, sum(values[name])))
+    for name in ["taskLatencyP50", "taskLatencyP95", "taskLatencyP99",
+                 "subtaskLatencyP50", "subtaskLatencyP95", "subtaskLatencyP99"]:
+        if name in values:
+            summary.append((name, sum(values[name]) / len(values[name])))
+    return summary
+
+def main():
+    parser = argparse.ArgumentParser(description="Run RemoteExec clients and servers as local processes")
+    parser.add_argument("--clients", type=int, default=2, help="number of client processes (default: 2)")
+    parser.add_argument("--servers", type=int, default=8, help="number of server processes (default: 8)")
+    parser.add_argument("--tasks", type=int, default=1000, help="tasks per client (default: 1000)")
+    parser.add_argument("--array-size", type=int, default=99, help="elements per task (default: 99)")
+    parser.add_argument("--subtasks", type=int, default=3, help="subtasks per task (default: 3)")
+    parser.add_argument("--in-flight", type=int, default=1, help="closed loop: tasks outstanding per client (default: 1)")
+    parser.add_argument("--rate", type=float, default=0, help="open loop: tasks/s per client, 0 = closed loop (default: 0)")
+    parser.add_argument("--service-time", type=float, default=0,
+                        help="seconds per element each server spins, like serviceTimePerElement (default: 0)")
+    parser.add_argument("--transport", choices=["unix", "tcp"], default="unix", help="socket type (default: unix)")
+    parser.add_argument("--base-port", type=int, default=47000, help="first TCP port (default: 47000)")
+    parser.add_argument("--honest", action="store_true", help="no malicious results")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: 1)")
+    parser.add_argument("--output", default="", help="also write the scalars to this file")
+    args = parser.parse_args()
+
+    scalars, failed = run_emulation(args)
+    for line in scalars:
+        print(line)
+    print()
+    for name, value in summarize(scalars):
+        print(f"{name:20s} {value:.6g}")
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write("\n".join(scalars) + "\n")
+
+    if failed:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
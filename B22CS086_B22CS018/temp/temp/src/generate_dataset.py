@@ -0,0 +1,42 @@
+import argparse
+import random
+import struct
+
+def generate_dataset_file(output_filename, num_elements, min_value, max_value, seed):
+    """
+    Write a raw binary dataset of native-endian 32-bit integers for the
+    Client's "file" dataset source.
+
+    Args:
+        output_filename (str): Name of the output file
+        num_elements (int): Number of integers to write
+        min_value (int): Smallest value
+        max_value (int): Largest value
+        seed (int): Seed so that datasets can be reproduced
+    """
+    rng = random.Random(seed)
+    block_size = 1 << 16
+
+    with open(output_filename, 'wb') as f:
+        written = 0
+        while written < num_elements:
+            count = min(block_size, num_elements - written)
+            block = [rng.randint(min_value, max_value) for _ in range(count)]
+            f.write(struct.pack(f"={count}i", *block))
+            written += count
+
+    print(f"Dataset file generated: {output_filename} ({num_elements} elements)")
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a binary dataset file for RemoteExecNetwork clients")
+    parser.add_argument("--elements", type=int, default=1000000, help="number of integers (default: 1000000)")
+    parser.add_argument("--min", type=int, default=1, help="smallest value (default: 1)")
+    parser.add_argument("--max", type=int, default=100, help="largest value (default: 100)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: 1)")
+    parser.add_argument("--output", default="data.bin", help="output file name (default: data.bin)")
+    args = parser.parse_args()
+
+    generate_dataset_file(args.output, args.elements, args.min, args.max, args.seed)
+
+if __name__ == "__main__":
+    main()
@@ -17,6 +17,12 @@ def generate_ned_file(output_filename, num_clients, num_servers, array_size, num
         # Write package and imports
         f.write("package temp;\n\n")
         
+        # Write client-server link definition
+        f.write("// Client-server link; the default 0bps datarate means no transmission delay\n")
+        f.write("channel Link extends ned.DatarateChannel\n{\n")
+        f.write("    datarate = default(0bps);\n")
+        f.write("}\n\n")
+
         # Write client module definition
         f.write("simple Client\n{\n")
         f.write("parameters:\n")
@@ -24,25 +30,89 @@ def generate_ned_file(output_filename, num_clients, num_servers, array_size, num
         f.write("    int numSubtasks;\n")
         f.write("    int numServers;\n")
         f.write("    int numClients;\n")
+        f.write("    string resultCache = default(\"none\"); // none, local or shared\n")
+        f.write("    int resultCacheCapacity = default(1024); // max cached subtask results\n")
+        f.write("    int aggregationFanIn = default(0); // children per aggregator node, 0 = results go straight to the client\n")
+        f.write("    string chunkingPolicy = default(\"fixed\"); // fixed or adaptive (sized from measured server throughput)\n")
+        f.write("    string datasetSource = default(\"random\"); // random, stream or file\n")
+        f.write("    string datasetFile = default(\"\"); // raw int32 file used by the file source\n")
+        f.write("    int datasetOffset = default(0); // element where task 1 starts in datasetFile\n")
+        f.write("    int fragmentSize = default(0); // elements per TaskMessage fragment, 0 = one message per subtask\n")
+        f.write("    bool coalesceDispatch = default(false); // one TaskMessage and one ResultMessage per server and task\n")
+        f.write("    string job = default(\"max\"); // max, or wordCount (map, shuffle and reduce stages)\n")
+        f.write("    int reducePartitions = default(2); // hash partitions of a wordCount job's reduce stage\n")
+        f.write("    string taskGraph = default(\"\"); // subtask dependencies such as \"0>2,1>2\" (2 also reduces the results of 0 and 1), \"\" = independent\n")
+        f.write("    string reputationTable = default(\"dense\"); // dense or sparse (rows only for observed servers)\n")
+        f.write("    string reputationLoad = default(\"\"); // snapshot to warm-start from (client index appended), \"\" = cold start\n")
+        f.write("    string reputationSave = default(\"\"); // snapshot written at finish (client index appended), \"\" = none\n")
+        f.write("    bool hedging = default(false); // re-dispatch subtasks without a majority by their deadline\n")
+        f.write("    double hedgeDelay @unit(s) = default(1s); // deadline until enough subtask latencies are observed\n")
+        f.write("    double hedgeQuantile = default(0.95); // observed subtask latency quantile used as the deadline\n")
+        f.write("    int maxHedges = default(2); // extra servers a subtask can be hedged to\n")
+        f.write("    string decisionLog = default(\"off\"); // off, record or replay the client's external inputs\n")
+        f.write("    string decisionLogFile = default(\"decisions.log\"); // base name, the client index is appended\n")
+        f.write("    int messagePoolCapacity = default(256); // recycled messages kept by the module, 0 = allocate every message\n")
         f.write("gates:\n")
         f.write("    input in[]; // message from server\n")
         f.write("    output out[]; // sending to server\n")
         f.write("    input gin[]; // gossip receive\n")
         f.write("    output gout[]; // gossip send\n")
+        f.write("    input directIn @directIn; // aggregates from the aggregation tree\n")
         f.write("}\n\n")
         
         # Write server module definition
         f.write("simple Server\n{\n")
+        f.write("parameters:\n")
+        f.write("    double serviceTimePerElement @unit(s) = default(0s); // 0 = subtasks are served instantly\n")
+        f.write("    int batchSize = default(1); // subtasks computed together in one kernel pass, 1 = no batching\n")
+        f.write("    double batchWindow @unit(s) = default(0s); // longest wait for a batch to fill after its first subtask, 0 = only batch what queued up\n")
+        f.write("    double batchOverhead @unit(s) = default(0s); // fixed service time of every kernel pass, shared by its subtasks\n")
+        f.write("    string computeBackend = default(\"model\"); // model (serviceTimePerElement) or threads (measured on the host thread pool)\n")
+        f.write("    int kernelThreads = default(0); // host threads of the shared pool, 0 = one per core\n")
+        f.write("    double measuredTimeScale = default(1.0); // simulated seconds per measured wall-clock second of a kernel\n")
+        f.write("    int stealAttempts = default(2); // random peers asked in a row when out of work (with workStealing)\n")
+        f.write("    double stealBackoff @unit(s) = default(10ms); // first wait between steal rounds while idle, doubled after each\n")
+        f.write("    double stealBackoffMax @unit(s) = default(100ms); // longest wait between steal rounds\n")
+        f.write("    int messagePoolCapacity = default(256); // recycled messages kept by the module, 0 = allocate every message\n")
         f.write("gates:\n")
         f.write("    input in[]; // receiving from client\n")
         f.write("    output out[]; // sending to client\n")
+        f.write("    input faultIn @directIn; // commands from the fault injector\n")
+        f.write("    input stealIn @directIn; // steal requests and stolen subtasks from other servers\n")
+        f.write("    input shuffleIn @directIn; // map partitions from other servers (wordCount jobs)\n")
         f.write("}\n\n")
         
+        # Write aggregator module definition
+        f.write("simple Aggregator\n{\n")
+        f.write("parameters:\n")
+        f.write("    int messagePoolCapacity = default(256); // recycled messages kept by the module, 0 = allocate every message\n")
+        f.write("gates:\n")
+        f.write("    input directIn @directIn; // results from servers, aggregates from child aggregators\n")
+        f.write("}\n\n")
+
+        # Write fault injector module definition
+        f.write("simple FaultInjector\n{\n")
+        f.write("parameters:\n")
+        f.write("    string faultScript = default(\"\"); // timeline of server and link faults, empty = no faults\n")
+        f.write("}\n\n")
+
+        # Write metrics exporter module definition
+        f.write("simple MetricsExporter\n{\n")
+        f.write("parameters:\n")
+        f.write("    double interval @unit(s) = default(0s); // time between snapshots, 0 = disabled\n")
+        f.write("    string metricsFile = default(\"metrics.csv\"); // rotated to <metricsFile>.1 when full\n")
+        f.write("    string metricsFormat = default(\"csv\"); // csv or json (one object per line)\n")
+        f.write("    int maxSnapshots = default(10000); // snapshots per file before it rotates\n")
+        f.write("    string memoryReport = default(\"memory.txt\"); // peak bytes per structure at finish, empty = scalars only\n")
+        f.write("}\n\n")
+
         # Start RemoteExecNetwork definition
         f.write("network RemoteExecNetwork\n{\n")
         f.write("parameters:\n")
         f.write(f"    int numClients = default({num_clients});\n")
         f.write(f"    int numServers = default({num_servers});\n")
+        f.write("    int numAggregators = default(0);\n")
+        f.write("    bool workStealing = default(false); // idle servers take queued subtasks from busy peers\n")
         
         # Define submodules
         f.write("submodules:\n")
@@ -54,6 +124,9 @@ def generate_ned_file(output_filename, num_clients, num_servers, array_size, num
         f.write(f"            numClients = {num_clients};\n")
         f.write("    }\n")
         f.write("    server[numServers]: Server;\n")
+        f.write("    aggregator[numAggregators]: Aggregator;\n")
+        f.write("    faultInjector: FaultInjector;\n")
+        f.write("    metrics: MetricsExporter;\n")
         
         # Start connections section
         f.write("connections allowunconnected:\n")
@@ -62,9 +135,9 @@ def generate_ned_file(output_filename, num_clients, num_servers, array_size, num
         for client_id in range(num_clients):
             for server_id in range(num_servers):
                 # Client → Server
-                f.write(f"    client[{client_id}].out++ --> server[{server_id}].in++;\n")
+                f.write(f"    client[{client_id}].out++ --> Link --> server[{server_id}].in++;\n")
                 # Server → Client
-                f.write(f"    server[{server_id}].out++ --> client[{client_id}].in++;\n")
+                f.write(f"    server[{server_id}].out++ --> Link --> client[{client_id}].in++;\n")
         
         # Client-client connections for gossip protocol
         for src_client in range(num_clients):